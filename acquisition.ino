@@ -0,0 +1,666 @@
+#include "config.h"
+#include <Wire.h>
+
+// AS7341 registers used to start a measurement without blocking
+#define AS7341_ADDRESS 0x39
+#define AS7341_ENABLE 0x80
+#define AS7341_ATIME 0x81
+#define AS7341_CFG0 0xA9
+#define AS7341_CFG1 0xAA
+#define AS7341_CFG6 0xAF
+#define AS7341_ASTEP_L 0xCA
+#define AS7341_ASTEP_H 0xCB
+#define AS7341_STATUS 0x93
+#define AS7341_ASTATUS 0x94
+#define AS7341_STATUS2 0xA3
+#define AS7341_PERS 0xBD
+#define AS7341_INTENAB 0xF9
+
+#define AS7341_ENABLE_SP_EN 0x02
+#define AS7341_ENABLE_SMUXEN 0x10
+#define AS7341_CFG0_REG_BANK 0x10
+#define AS7341_CFG6_SMUX_WRITE 0x10
+#define AS7341_STATUS2_AVALID 0x40
+#define AS7341_INTENAB_SP_IEN 0x08
+
+// A group that has not delivered a measurement after this many integration
+// times plus the margin is restarted once, then the scan is finalized
+#define ACQ_GROUP_TIMEOUT_FACTOR 4
+#define ACQ_GROUP_TIMEOUT_MARGIN_MS 100
+
+// SMUX routing for the two channel groups (same maps as the DFRobot driver)
+const uint8_t smuxF1F4ClearNIR[20] = {
+  0x30, 0x01, 0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x50, 0x00,
+  0x00, 0x00, 0x20, 0x04, 0x00, 0x30, 0x01, 0x50, 0x00, 0x06
+};
+const uint8_t smuxF5F8ClearNIR[20] = {
+  0x00, 0x00, 0x00, 0x40, 0x02, 0x00, 0x10, 0x03, 0x50, 0x10,
+  0x03, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x50, 0x00, 0x06
+};
+
+// Acquisition state
+volatile AcqState acqState = ACQ_IDLE;
+uint32_t currentScanId = 0;
+uint32_t completedScanId = 0;
+uint32_t acquisitionTimeouts = 0;
+
+// Reading index fed by each ADC in a group. Clear and NIR are routed in both
+// groups but only taken from group 1.
+const int8_t group1Channels[6] = {0, 1, 2, 3, 9, 8};
+const int8_t group2Channels[6] = {4, 5, 6, 7, -1, -1};
+
+uint16_t group1Counts[6];
+uint16_t group2Counts[6];
+
+// Exposure currently programmed into the sensor, and the one each group's
+// last measurement was taken with
+Exposure appliedExposure = {0xFF, 0, 0};
+Exposure sampleExposure[2];
+uint8_t sampleStatus[2];
+bool sampleRetry[2];
+
+// When the running group was started, and whether it already timed out once
+unsigned long groupStartTime = 0;
+bool groupRestarted = false;
+
+// HDR mode alternates samples between the auto-exposed bracket and a long one.
+// longReadingCount counts the samples taken in the long bracket.
+bool bracketLong = false;
+int longReadingCount = 0;
+
+// Per-channel sums in basic counts for the short [0] and long [1] bracket, so
+// samples taken at different exposures add up. Saturated long samples are
+// left out; the channel then falls back to the short bracket. bracketDark
+// counts the samples that had a dark offset subtracted.
+float bracketSum[2][10];
+uint16_t bracketCount[2][10];
+uint16_t bracketSaturated[2][10];
+uint16_t bracketDark[2][10];
+bool saturatedChannels[10];
+bool darkApplied = false;
+
+// A dark scan averages raw counts per ADC instead of producing a spectrum,
+// per bracket in HDR mode so both exposures get a reference
+ScanKind scanKind = SCAN_NORMAL;
+float darkSum[2][2][6];
+int darkCount[2];
+Exposure darkExposure[2][2];
+
+// Dark offsets for each bracket and group, looked up again only when the
+// exposure they are for changes or while loop() is still loading them
+float darkRef[2][2][6];
+Exposure darkRefExposure[2][2];
+DarkLookup darkRefState[2][2];
+
+int readingCount = 0;
+unsigned long acqStartTime = 0;
+uint64_t acqStartUs = 0;
+unsigned long integratedUs = 0;
+unsigned long busUs = 0;
+
+TaskHandle_t sensorTaskHandle = NULL;
+
+// Device-side continuous mode
+bool continuousMode = false;
+unsigned long lastScheduledScan = 0;
+
+// Double-buffered handoff to the HTTP side. The sensor task fills the back
+// slot and then flips frontSlot. Each slot's sequence count is odd while it is
+// being written, so a reader that raced a second publish retries its copy.
+SpectrumFrame spectrumSlots[2];
+volatile uint32_t spectrumSlotSeq[2] = {0, 0};
+volatile uint8_t frontSlot = 0;
+
+void publishSpectrum() {
+  uint8_t back = frontSlot ^ 1;
+  SpectrumFrame& frame = spectrumSlots[back];
+
+  spectrumSlotSeq[back]++;
+  __sync_synchronize();
+  frame.scanId = currentScanId;
+  frame.startTime = scanStartTime;
+  frame.elapsedTime = scanElapsedTime;
+  frame.readingCount = readingCount;
+  frame.dutyCycle = scanElapsedTime > 0 ? integratedUs / (scanElapsedTime * 1000.0f) : 0;
+  frame.exposure[0] = sampleExposure[0];
+  frame.exposure[1] = sampleExposure[1];
+  frame.hdr = longReadingCount > 0;
+  frame.darkCorrected = darkApplied;
+  memcpy(frame.saturated, saturatedChannels, sizeof(frame.saturated));
+  memcpy(frame.readings, normalizedReadings, sizeof(frame.readings));
+  memcpy(frame.interpolated, interpolatedSpectrum, sizeof(frame.interpolated));
+  __sync_synchronize();
+  spectrumSlotSeq[back]++;
+
+  frontSlot = back;
+  historyAppend(frame);
+}
+
+// Id of the most recently published scan, without copying it
+uint32_t latestSpectrumId() {
+  return spectrumSlots[frontSlot].scanId;
+}
+
+// Copy the most recently published scan. Safe to call from any task.
+void readLatestSpectrum(SpectrumFrame& out) {
+  for (;;) {
+    uint8_t slot = frontSlot;
+    uint32_t seq = spectrumSlotSeq[slot];
+    if (seq & 1) continue;
+    __sync_synchronize();
+    memcpy(&out, &spectrumSlots[slot], sizeof(out));
+    __sync_synchronize();
+    if (spectrumSlotSeq[slot] == seq) return;
+  }
+}
+
+void as7341WriteReg(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(AS7341_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  i2cCheck(I2C_BUS_SENSOR, Wire.endTransmission() == 0);
+}
+
+// Read one register. On a bus error value is left alone and false returned,
+// so callers never mistake a failed read for a register holding 0.
+bool as7341ReadReg(uint8_t reg, uint8_t& value) {
+  Wire.beginTransmission(AS7341_ADDRESS);
+  Wire.write(reg);
+  if (!i2cCheck(I2C_BUS_SENSOR, Wire.endTransmission(false) == 0)) {
+    return false;
+  }
+  if (!i2cCheck(I2C_BUS_SENSOR, Wire.requestFrom((uint8_t)AS7341_ADDRESS, (size_t)1) == 1)) {
+    return false;
+  }
+  value = Wire.read();
+  return true;
+}
+
+// Program gain and integration time, writing only the registers that differ
+// from what the sensor already holds. SP_EN must be off.
+void as7341ApplyExposure(const Exposure& e) {
+  if (e.gain != appliedExposure.gain) {
+    as7341WriteReg(AS7341_CFG1, e.gain);
+  }
+  if (e.atime != appliedExposure.atime || appliedExposure.gain == 0xFF) {
+    as7341WriteReg(AS7341_ATIME, e.atime);
+  }
+  if (e.astep != appliedExposure.astep || appliedExposure.gain == 0xFF) {
+    as7341WriteReg(AS7341_ASTEP_L, e.astep & 0xFF);
+    as7341WriteReg(AS7341_ASTEP_H, e.astep >> 8);
+  }
+  appliedExposure = e;
+}
+
+// Route one channel group to the ADCs and start integrating, without waiting
+// for the result. Completion is picked up by as7341MeasurementReady(). Returns
+// false, leaving ENABLE untouched, if CFG0 or ENABLE could not be read; the
+// group deadline then restarts it.
+bool as7341StartGroup(const uint8_t* smux, const Exposure& e) {
+  uint8_t cfg0;
+  if (!as7341ReadReg(AS7341_CFG0, cfg0)) {
+    return false;
+  }
+  as7341WriteReg(AS7341_CFG0, cfg0 & ~AS7341_CFG0_REG_BANK);
+
+  uint8_t enable;
+  if (!as7341ReadReg(AS7341_ENABLE, enable)) {
+    return false;
+  }
+  enable &= ~AS7341_ENABLE_SP_EN;
+  as7341WriteReg(AS7341_ENABLE, enable);
+  // Release INT, which stays latched low from any cycle nobody read (e.g.
+  // at boot), so the end of this measurement produces a falling edge
+  as7341WriteReg(AS7341_STATUS, 0xFF);
+  as7341ApplyExposure(e);
+  as7341WriteReg(AS7341_CFG6, AS7341_CFG6_SMUX_WRITE);
+  for (uint8_t reg = 0; reg < 20; reg++) {
+    as7341WriteReg(reg, smux[reg]);
+  }
+
+  // SMUXEN self-clears once the routing is applied (a few hundred microseconds)
+  as7341WriteReg(AS7341_ENABLE, enable | AS7341_ENABLE_SMUXEN);
+  uint8_t smuxen;
+  for (int i = 0; i < 100 && as7341ReadReg(AS7341_ENABLE, smuxen) && (smuxen & AS7341_ENABLE_SMUXEN); i++) {
+    delayMicroseconds(100);
+  }
+
+  as7341WriteReg(AS7341_ENABLE, enable | AS7341_ENABLE_SP_EN);
+  return true;
+}
+
+// Stop spectral measurements between scans and release INT
+void as7341StopMeasurement() {
+  uint8_t enable;
+  if (as7341ReadReg(AS7341_ENABLE, enable)) {
+    as7341WriteReg(AS7341_ENABLE, enable & ~AS7341_ENABLE_SP_EN);
+  }
+  as7341WriteReg(AS7341_STATUS, 0xFF);
+}
+
+bool as7341MeasurementReady() {
+  uint8_t status2;
+  return as7341ReadReg(AS7341_STATUS2, status2) && (status2 & AS7341_STATUS2_AVALID);
+}
+
+// Fetch ASTATUS and all six ADC words in one auto-incrementing read. Reading
+// ASTATUS first latches the data registers, so all words are from one cycle.
+bool as7341ReadChannels(uint16_t counts[6], uint8_t& astatus) {
+  uint8_t buf[13];
+  Wire.beginTransmission(AS7341_ADDRESS);
+  Wire.write(AS7341_ASTATUS);
+  if (!i2cCheck(I2C_BUS_SENSOR, Wire.endTransmission(false) == 0)) {
+    return false;
+  }
+  if (!i2cCheck(I2C_BUS_SENSOR, Wire.requestFrom((uint8_t)AS7341_ADDRESS, (size_t)sizeof(buf)) == sizeof(buf))) {
+    return false;
+  }
+  Wire.readBytes(buf, sizeof(buf));
+  astatus = buf[0];
+  for (int i = 0; i < 6; i++) {
+    counts[i] = buf[1 + 2 * i] | (buf[2 + 2 * i] << 8);
+  }
+  return true;
+}
+
+// Set once a wait timed out on a measurement that was in fact complete: INT
+// is not wired to AS7341_INT_PIN, so waits poll from then on
+bool as7341IntMissing = false;
+bool as7341WaitTimedOut = false;
+
+void IRAM_ATTR as7341Isr() {
+  BaseType_t woken = pdFALSE;
+  if (sensorTaskHandle != NULL) {
+    vTaskNotifyGiveFromISR(sensorTaskHandle, &woken);
+  }
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Raise INT at the end of every spectral cycle (persistence 0) so the sensor
+// task is woken the moment a measurement completes.
+void as7341EnableInterrupt() {
+  if (AS7341_INT_PIN < 0) {
+    return;
+  }
+  as7341WriteReg(AS7341_PERS, 0x00);
+  uint8_t intenab;
+  if (as7341ReadReg(AS7341_INTENAB, intenab)) {
+    as7341WriteReg(AS7341_INTENAB, intenab | AS7341_INTENAB_SP_IEN);
+  }
+  as7341WriteReg(AS7341_STATUS, 0xFF);
+  pinMode(AS7341_INT_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(AS7341_INT_PIN), as7341Isr, FALLING);
+}
+
+// Block until the running measurement may be complete: on the INT edge, or
+// after one tick when no interrupt line is wired.
+void as7341WaitForMeasurement() {
+  if (AS7341_INT_PIN < 0 || as7341IntMissing) {
+    vTaskDelay(1);
+    return;
+  }
+  // Time out at twice the integration time in case an edge was missed
+  TickType_t timeout = pdMS_TO_TICKS(as7341IntegrationTimeUs(appliedExposure) / 500 + 2);
+  as7341WaitTimedOut = ulTaskNotifyTake(pdTRUE, timeout) == 0;
+}
+
+// Called with the result of the readiness check that follows a wait
+void as7341CheckInterrupt(bool ready) {
+  if (ready && as7341WaitTimedOut && !as7341IntMissing) {
+    as7341IntMissing = true;
+    Serial.println("No AS7341 interrupt on INT pin, polling instead.");
+  }
+  as7341WaitTimedOut = false;
+}
+
+// Exposure for the next measurement of a group, honoring the HDR bracket
+Exposure nextExposure(int group) {
+  return (hdrMode && bracketLong) ? hdrLongExposure(groupExposure[group]) : groupExposure[group];
+}
+
+// Whether the long bracket would collect more than the short one in both
+// groups. It cannot once the short exposure is at the top of the range.
+bool hdrBracketUseful() {
+  for (int g = 0; g < 2; g++) {
+    if (!exposureLonger(hdrLongExposure(groupExposure[g]), groupExposure[g])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Route and start the next measurement of a group and arm its deadline.
+// The caller holds the I2C bus.
+void startGroup(int group) {
+  as7341StartGroup(group ? smuxF5F8ClearNIR : smuxF1F4ClearNIR, nextExposure(group));
+  groupStartTime = millis();
+}
+
+bool groupTimedOut() {
+  unsigned long limit = as7341IntegrationTimeUs(appliedExposure) * ACQ_GROUP_TIMEOUT_FACTOR / 1000 +
+                        ACQ_GROUP_TIMEOUT_MARGIN_MS;
+  return millis() - groupStartTime > limit;
+}
+
+// Dark offsets for the last sample of a group in a bracket, or NULL if none
+// are known (yet) for its exposure
+const float* resolveDark(int bracket, int group) {
+  const Exposure& e = sampleExposure[group];
+  Exposure& looked = darkRefExposure[bracket][group];
+  DarkLookup& state = darkRefState[bracket][group];
+  if (state == DARK_PENDING || looked.gain != e.gain || looked.atime != e.atime || looked.astep != e.astep) {
+    looked = e;
+    state = darkLookup(group, e, darkRef[bracket][group]);
+  }
+  return state == DARK_FOUND ? darkRef[bracket][group] : NULL;
+}
+
+void accumulateGroup(int bracket, const uint16_t* counts, const int8_t* channels, int group, const float* dark) {
+  uint16_t peak = *std::max_element(counts, counts + 6);
+  for (int i = 0; i < 6; i++) {
+    int ch = channels[i];
+    if (ch < 0) continue;
+    bool saturated = channelSaturated(counts[i], peak, sampleStatus[group], sampleExposure[group]);
+    if (saturated) {
+      bracketSaturated[bracket][ch]++;
+      if (bracket == 1) continue;
+    }
+    float value = counts[i] - (dark != NULL ? dark[i] : 0.0f);
+    bracketSum[bracket][ch] += toBasicCounts(value, sampleExposure[group]);
+    bracketCount[bracket][ch]++;
+    if (dark != NULL) {
+      bracketDark[bracket][ch]++;
+    }
+  }
+}
+
+// Queue a new scan. Returns its id, or 0 if one is already running.
+// Only the HTTP side leaves ACQ_IDLE and only the sensor task returns to it,
+// so the two never write acqState at the same time.
+uint32_t requestScan(ScanKind kind) {
+  if (acqState != ACQ_IDLE) {
+    return 0;
+  }
+  if (!autoExposure) {
+    resetExposure();
+  }
+  // Have the references the scan starts with in the cache, so the sensor
+  // task does not wait on flash for them
+  if (kind == SCAN_NORMAL) {
+    for (int g = 0; g < 2; g++) {
+      darkPrefetch(g, groupExposure[g]);
+      if (hdrMode && hdrBracketUseful()) {
+        darkPrefetch(g, hdrLongExposure(groupExposure[g]));
+      }
+    }
+  }
+  scanKind = kind;
+  currentScanId++;
+  acqState = ACQ_START;
+  xTaskNotifyGive(sensorTaskHandle);
+  return currentScanId;
+}
+
+void setContinuous(bool on) {
+  continuousMode = on;
+  lastScheduledScan = 0;
+}
+
+// Start a scan every scanInterval seconds (start to start) while continuous
+// mode is on. Runs from loop(), the same side that handles /start.
+void scheduleScans() {
+  if (!continuousMode || acqState != ACQ_IDLE) {
+    return;
+  }
+  if (lastScheduledScan == 0 || millis() - lastScheduledScan >= scanInterval * 1000UL) {
+    if (requestScan() != 0) {
+      lastScheduledScan = millis();
+    }
+  }
+}
+
+// Advance the acquisition by at most one step. Runs on the sensor task and
+// holds the I2C bus only for the register transactions of that step.
+void acquisitionStep() {
+  switch (acqState) {
+    case ACQ_IDLE:
+      break;
+
+    case ACQ_START: {
+      uint32_t serialSpan = traceBegin();
+      Serial.println(scanKind == SCAN_DARK ? "Starting dark capture..." : "Starting accumulation...");
+      traceEnd(serialSpan, "serial", "sensor");
+      memset(bracketSum, 0, sizeof(bracketSum));
+      memset(bracketCount, 0, sizeof(bracketCount));
+      memset(bracketSaturated, 0, sizeof(bracketSaturated));
+      memset(bracketDark, 0, sizeof(bracketDark));
+      memset(darkSum, 0, sizeof(darkSum));
+      memset(darkCount, 0, sizeof(darkCount));
+      for (int b = 0; b < 2; b++) {
+        darkRefState[b][0] = DARK_PENDING;
+        darkRefState[b][1] = DARK_PENDING;
+      }
+      bracketLong = false;
+      longReadingCount = 0;
+      readingCount = 0;
+      integratedUs = 0;
+      busUs = 0;
+      acqStartTime = millis();
+      acqStartUs = traceClockUs();
+      scanStartTime = acqStartTime;
+      scanElapsedTime = 0;
+      collecting = true;
+      displayDirty = true;
+      groupRestarted = false;
+      xSemaphoreTake(i2cMutex, portMAX_DELAY);
+      uint32_t busSpan = traceBegin();
+      startGroup(0);
+      unsigned long busTime = traceEnd(busSpan, "i2c", "sensor");
+      busUs += busTime;
+      metricsObserve(i2cLatency, busTime);
+      xSemaphoreGive(i2cMutex);
+      acqState = ACQ_GROUP1;
+      break;
+    }
+
+    case ACQ_GROUP1:
+    case ACQ_GROUP2: {
+      int group = (acqState == ACQ_GROUP2) ? 1 : 0;
+      uint16_t* counts = group ? group2Counts : group1Counts;
+      xSemaphoreTake(i2cMutex, portMAX_DELAY);
+      uint32_t busSpan = traceBegin();
+      bool ready = as7341MeasurementReady();
+      as7341CheckInterrupt(ready);
+      if (ready) {
+        uint8_t astatus = 0;
+        bool ok = as7341ReadChannels(counts, astatus);
+        as7341WriteReg(AS7341_STATUS, 0xFF);
+        if (ok) {
+          groupRestarted = false;
+          uint16_t peak = *std::max_element(counts, counts + 6);
+          bool saturated = channelSaturated(peak, peak, astatus, appliedExposure);
+          sampleExposure[group] = appliedExposure;
+          sampleStatus[group] = astatus;
+          sampleRetry[group] = false;
+          // In HDR mode only the short bracket drives auto exposure, and a
+          // dark capture keeps the settings it is recording an offset for
+          if (autoExposure && scanKind == SCAN_NORMAL && !(hdrMode && bracketLong)) {
+            sampleRetry[group] = adjustExposure(groupExposure[group], peak, saturated) && saturated;
+          }
+        }
+        if (!ok) {
+          // Drop the partial sample and start over from group 1
+          startGroup(0);
+          acqState = ACQ_GROUP1;
+        } else if (group == 0) {
+          startGroup(1);
+          acqState = ACQ_GROUP2;
+        } else {
+          acqState = ACQ_ACCUMULATE;
+        }
+      } else if (groupTimedOut()) {
+        // The sensor never finished (brown-out, reset or a failed start).
+        // Reprogram everything and try the group once more, then give up
+        // and finalize with what was collected so the scan cannot hang.
+        acquisitionTimeouts++;
+        Serial.println(groupRestarted ? "Sensor timed out again, ending scan." : "Sensor timed out, restarting group.");
+        if (!groupRestarted) {
+          groupRestarted = true;
+          appliedExposure.gain = 0xFF;
+          startGroup(group);
+        } else {
+          acqState = ACQ_FINALIZE;
+        }
+      }
+      unsigned long busTime = traceEnd(busSpan, "i2c", "sensor");
+      busUs += busTime;
+      metricsObserve(i2cLatency, busTime);
+      xSemaphoreGive(i2cMutex);
+      break;
+    }
+
+    case ACQ_ACCUMULATE: {
+      bool windowOver = millis() - acqStartTime >= accumulationTime * 1000;
+      integratedUs += as7341IntegrationTimeUs(sampleExposure[0]) + as7341IntegrationTimeUs(sampleExposure[1]);
+
+      // A saturated sample is thrown away when the exposure has just been
+      // lowered for it, unless the window is over and nothing better exists.
+      int bracket = (hdrMode && bracketLong) ? 1 : 0;
+      bool retry = sampleRetry[0] || sampleRetry[1];
+      if (scanKind == SCAN_DARK) {
+        for (int i = 0; i < 6; i++) {
+          darkSum[bracket][0][i] += group1Counts[i];
+          darkSum[bracket][1][i] += group2Counts[i];
+        }
+        darkExposure[bracket][0] = sampleExposure[0];
+        darkExposure[bracket][1] = sampleExposure[1];
+        darkCount[bracket]++;
+        readingCount++;
+      } else if (!retry || (windowOver && readingCount == 0)) {
+        accumulateGroup(bracket, group1Counts, group1Channels, 0, resolveDark(bracket, 0));
+        accumulateGroup(bracket, group2Counts, group2Channels, 1, resolveDark(bracket, 1));
+        readingCount++;
+        if (bracket == 1) {
+          longReadingCount++;
+        }
+      }
+      // Skip the long bracket while it would only repeat the short one
+      if (hdrMode) {
+        bracketLong = !bracketLong && hdrBracketUseful();
+      }
+
+      if (!windowOver) {
+        xSemaphoreTake(i2cMutex, portMAX_DELAY);
+        uint32_t busSpan = traceBegin();
+        startGroup(0);
+        unsigned long busTime = traceEnd(busSpan, "i2c", "sensor");
+        busUs += busTime;
+        metricsObserve(i2cLatency, busTime);
+        xSemaphoreGive(i2cMutex);
+        acqState = ACQ_GROUP1;
+      } else {
+        acqState = ACQ_FINALIZE;
+      }
+      break;
+    }
+
+    case ACQ_FINALIZE: {
+      scanElapsedTime = millis() - scanStartTime;
+      xSemaphoreTake(i2cMutex, portMAX_DELAY);
+      as7341StopMeasurement();
+      xSemaphoreGive(i2cMutex);
+      uint32_t span = traceBegin();
+      Serial.print("Accumulated ");
+      Serial.print(readingCount);
+      Serial.print(" readings, sensor duty cycle ");
+      Serial.print(scanElapsedTime > 0 ? integratedUs / (scanElapsedTime * 10.0f) : 0, 1);
+      Serial.print("%, I2C ");
+      Serial.print(readingCount > 0 ? busUs / readingCount : 0);
+      Serial.println("us per reading.");
+      traceEnd(span, "serial", "sensor");
+
+      if (scanKind == SCAN_DARK) {
+        // Record the offsets for the settings each group and bracket was
+        // captured at
+        for (int b = 0; b < 2; b++) {
+          for (int g = 0; g < 2 && darkCount[b] > 0; g++) {
+            float offsets[6];
+            for (int i = 0; i < 6; i++) {
+              offsets[i] = darkSum[b][g][i] / darkCount[b];
+            }
+            if (!storeDark(g, darkExposure[b][g], offsets)) {
+              Serial.println("Dark cache full of unsaved references, one dropped.");
+            }
+          }
+        }
+        Serial.println("Dark reference stored.");
+      } else {
+        // Average each channel, preferring the long bracket wherever it never
+        // clipped. The frame counts as dark corrected only if every sample
+        // behind every channel was.
+        darkApplied = true;
+        for (int i = 0; i < 10; i++) {
+          int bracket = (bracketCount[1][i] > 0 && bracketSaturated[1][i] == 0) ? 1 : 0;
+          normalizedReadings[i] = bracketCount[bracket][i] > 0 ? bracketSum[bracket][i] / bracketCount[bracket][i] : 0;
+          saturatedChannels[i] = bracketSaturated[bracket][i] > 0;
+          if (bracketCount[bracket][i] == 0 || bracketDark[bracket][i] < bracketCount[bracket][i]) {
+            darkApplied = false;
+          }
+        }
+        span = traceBegin();
+        generateInterpolatedSpectrum();
+        metricsObserve(interpolationLatency, traceEnd(span, "interpolate", "sensor"));
+        span = traceBegin();
+        publishSpectrum();
+        traceEnd(span, "publish", "sensor");
+      }
+      completedScanId = currentScanId;
+      collecting = false;
+      displayDirty = true;
+      traceSpan(scanKind == SCAN_DARK ? "dark scan" : "scan", "sensor", acqStartUs, traceClockUs() - acqStartUs);
+      acqState = ACQ_IDLE;
+      Serial.println("Data collection and processing complete.");
+      break;
+    }
+  }
+}
+
+// Fraction of the accumulation window that has elapsed for the running scan
+float acquisitionProgress() {
+  if (acqState == ACQ_IDLE) {
+    return completedScanId > 0 ? 1.0f : 0.0f;
+  }
+  if (acqState == ACQ_START) {
+    return 0.0f;
+  }
+  float progress = (float)(millis() - acqStartTime) / (accumulationTime * 1000.0f);
+  return min(progress, 1.0f);
+}
+
+const char* acquisitionStateName() {
+  switch (acqState) {
+    case ACQ_START: return "start";
+    case ACQ_GROUP1: return "group1";
+    case ACQ_GROUP2: return "group2";
+    case ACQ_ACCUMULATE: return "accumulate";
+    case ACQ_FINALIZE: return "finalize";
+    default: return "idle";
+  }
+}
+
+// Sensor task: sleeps until a scan is requested, then steps the acquisition,
+// sleeping on the AS7341 interrupt while the sensor integrates.
+void sensorTask(void* param) {
+  for (;;) {
+    if (acqState == ACQ_IDLE) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    acquisitionStep();
+    if (acqState == ACQ_GROUP1 || acqState == ACQ_GROUP2) {
+      as7341WaitForMeasurement();
+    }
+  }
+}
@@ -4,12 +4,55 @@
 // Include libraries INSIDE the header guard
 #include <WiFi.h>
 #include <WebServer.h>
+#include <WebSocketsServer.h>
 #include <Preferences.h>
 
 // I2C pins for AS7341 sensor
 #define SDA_PIN 2
 #define SCL_PIN 3
 
+// I2C buses (see i2c_bus.ino) and the clock rates they can be set to
+#define I2C_BUS_SENSOR 0 // Wire
+#define I2C_BUS_OLED 1   // Wire1
+#define I2C_BUS_COUNT 2
+#define I2C_CLOCK_STANDARD 100000
+#define I2C_CLOCK_FAST 400000
+#define I2C_CLOCK_FAST_PLUS 1000000
+
+// ASTATUS bit set when any channel of the last cycle saturated
+#define AS7341_ASTATUS_ASAT 0x80
+
+// AS7341 INT output (open drain, active low), see the wiring in README.md.
+// Set to -1 to poll STATUS2 instead; an unwired pin is detected on the first
+// measurement and polling takes over.
+#define AS7341_INT_PIN 4
+
+// Binary command channel (see websocket.ino)
+#define WS_PORT 81
+
+// Limits enforced on the tunables set over HTTP or the WebSocket
+#define ACCUMULATION_TIME_MAX 60 // seconds
+#define SCAN_INTERVAL_MAX 3600   // seconds
+#define EXPOSURE_TARGET_MIN 0.1f
+#define EXPOSURE_TARGET_MAX 0.8f
+#define SENSOR_GAIN_MAX 10 // AGAIN register value, 512x
+#define SENSOR_ASTEP_MAX 65534
+
+// Room for one scan serialized as /data JSON (about 2.8 KB in practice)
+#define DATA_JSON_SIZE 4096
+
+// Size of one scan in the binary format of spectrum_format.ino
+#define SPECTRUM_BIN_SIZE (44 + 2 * 100 + 4 * 10)
+
+// Buckets of each latency histogram in metrics.ino, the last one unbounded
+#define METRICS_BUCKETS 10
+
+// Sensor task (acquisition + interpolation) runs apart from the HTTP loop, on
+// the core the Arduino loopTask is not pinned to
+#define SENSOR_TASK_CORE (1 - ARDUINO_RUNNING_CORE)
+#define SENSOR_TASK_PRIORITY 2
+#define SENSOR_TASK_STACK 4096
+
 // Global objects
 extern WebServer server;
 extern Preferences preferences;
@@ -20,22 +63,259 @@ extern String password;
 extern bool apMode;
 
 // Data collection variables
-extern bool collecting;
+extern volatile bool collecting;
 extern unsigned int accumulationTime;
+extern unsigned int scanInterval;
+extern bool continuousMode;
+extern unsigned long lastScheduledScan;
+extern uint8_t sensorGain;
+extern uint8_t sensorAtime;
+extern uint16_t sensorAstep;
+extern bool autoExposure;
+extern float exposureTarget;
+extern bool hdrMode;
+
+// AS7341 gain (AGAIN register value) and integration settings
+struct Exposure {
+  uint8_t gain;
+  uint8_t atime;
+  uint16_t astep;
+};
+
+extern Exposure groupExposure[2];
 extern const int interpolationPoints;
 extern float interpolatedSpectrum[100][2];
+extern float normalizedReadings[10];
+extern bool displayDirty;
+
+// Wire (the sensor bus) is shared by the sensor task and the LED control in loop()
+extern SemaphoreHandle_t i2cMutex;
+extern TaskHandle_t sensorTaskHandle;
+
+// One completed scan as handed from the sensor task to the HTTP side
+struct SpectrumFrame {
+  uint32_t scanId;
+  unsigned long startTime;
+  unsigned long elapsedTime;
+  int readingCount;
+  float dutyCycle;
+  Exposure exposure[2];
+  bool hdr;
+  bool darkCorrected;
+  bool saturated[10];
+  float readings[10];
+  float interpolated[100][2];
+};
+
+// Every tunable persisted by settings.ino
+struct Settings {
+  uint16_t accumulationTime;
+  uint16_t scanInterval;
+  bool autoExposure;
+  float exposureTarget;
+  bool hdr;
+  bool continuous;
+  uint8_t gain;  // manual exposure, used while autoExposure is off
+  uint8_t atime;
+  uint16_t astep;
+  uint32_t i2cClock[I2C_BUS_COUNT];
+};
+
+// Output state of json_writer.ino
+struct JsonWriter {
+  char* buf;
+  size_t capacity;
+  size_t len;
+  bool overflow;
+};
+
+// A gzipped web asset generated by tools/build_assets.py
+struct WebAsset {
+  const char* path;
+  const char* contentType;
+  const uint8_t* data;
+  size_t length;
+  const char* etag;
+  bool immutable; // content-hashed URL
+};
+
+// An /events subscriber and the tail of its messages the socket has not
+// taken yet (see events.ino), sized for one whole scan message
+#define EVENTS_PENDING_SIZE (DATA_JSON_SIZE + 256)
+
+struct EventClient {
+  WiFiClient client;
+  char pending[EVENTS_PENDING_SIZE];
+  size_t pendingLen;
+  unsigned long lastProgress; // millis() of the last byte sent
+  bool scanOwed;              // a scan arrived while a message was in flight
+};
+
+// Durations recorded for /metrics
+struct LatencyHistogram {
+  uint32_t buckets[METRICS_BUCKETS];
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+extern LatencyHistogram i2cLatency;
+extern LatencyHistogram interpolationLatency;
+extern LatencyHistogram serializeJsonLatency;
+extern LatencyHistogram serializeBinLatency;
+extern LatencyHistogram displayLatency;
+
+// One entry of the on-device scan history
+struct ScanRecord {
+  uint32_t seq;           // scan id, increases monotonically
+  uint32_t timestamp;     // millis() at scan start
+  uint32_t elapsedMs;
+  uint16_t readingCount;
+  uint16_t saturatedMask; // bit i set when channel i clipped
+  Exposure exposure[2];
+  float readings[10];     // channel averages in basic counts
+};
+
+// Acquisition state machine, advanced by the sensor task
+enum AcqState {
+  ACQ_IDLE,
+  ACQ_START,
+  ACQ_GROUP1,
+  ACQ_GROUP2,
+  ACQ_ACCUMULATE,
+  ACQ_FINALIZE
+};
+
+enum ScanKind {
+  SCAN_NORMAL,
+  SCAN_DARK
+};
+
+// Outcome of a dark reference lookup in dark.ino
+enum DarkLookup {
+  DARK_NONE,
+  DARK_FOUND,
+  DARK_PENDING
+};
+
+extern volatile AcqState acqState;
+extern uint32_t currentScanId;
+extern uint32_t completedScanId;
+extern uint32_t acquisitionTimeouts;
 
 // Function declarations from tricorder.ino
-void readAndAccumulate();
 void generateInterpolatedSpectrum();
 float getInterpolatedValue(float wavelength);
 float cubicInterpolate(float p0, float p1, float p2, float p3, float t);
+void setLight(bool on);
+
+// Function declarations from acquisition.ino
+uint32_t requestScan(ScanKind kind = SCAN_NORMAL);
+void acquisitionStep();
+void setContinuous(bool on);
+void scheduleScans();
+float acquisitionProgress();
+const char* acquisitionStateName();
+void as7341EnableInterrupt();
+void as7341StopMeasurement();
+void sensorTask(void* param);
+uint32_t latestSpectrumId();
+void readLatestSpectrum(SpectrumFrame& out);
+
+// Function declarations from dark.ino
+DarkLookup darkLookup(int group, const Exposure& e, float* offsets);
+void darkPrefetch(int group, const Exposure& e);
+bool storeDark(int group, const Exposure& e, const float* offsets);
+void serviceDark();
+void clearDark();
+
+// Function declarations from events.ino
+void handleEvents();
+void serviceEvents();
+
+// Function declarations from exposure.ino
+float as7341GainFactor(uint8_t gain);
+uint16_t as7341FullScale(const Exposure& e);
+unsigned long as7341IntegrationTimeUs(const Exposure& e);
+float toBasicCounts(float counts, const Exposure& e);
+void resetExposure();
+Exposure scaleExposure(const Exposure& e, int steps, uint16_t astepMin, uint16_t astepMax);
+Exposure hdrLongExposure(const Exposure& e);
+bool exposureLonger(const Exposure& a, const Exposure& b);
+bool channelSaturated(uint16_t count, uint16_t peak, uint8_t astatus, const Exposure& e);
+bool adjustExposure(Exposure& e, uint16_t peak, bool saturated);
+
+// Function declarations from history.ino
+void historyBegin();
+void historyAppend(const SpectrumFrame& frame);
+bool historyRead(uint32_t index, ScanRecord& out);
+void handleHistory();
+
+// Function declarations from i2c_bus.ino
+bool i2cClockValid(uint32_t hz);
+void i2cInitClock(int bus, uint32_t hz);
+uint32_t i2cClock(int bus);
+uint32_t i2cConfiguredClock(int bus);
+uint32_t i2cErrors(int bus);
+const char* i2cBusName(int bus);
+bool setI2cClock(int bus, uint32_t hz);
+bool i2cCheck(int bus, bool ok);
+
+// Function declarations from json_writer.ino
+void jsonBegin(JsonWriter& w, char* buf, size_t capacity);
+void jsonWrite(JsonWriter& w, const char* text, size_t n);
+void jsonRaw(JsonWriter& w, const char* text);
+void jsonBool(JsonWriter& w, bool value);
+void jsonString(JsonWriter& w, const char* text);
+void jsonUInt(JsonWriter& w, uint32_t value);
+void jsonFixed(JsonWriter& w, float value, int decimals);
+
+// Function declarations from metrics.ino
+void metricsObserve(LatencyHistogram& h, uint32_t us);
+WebServer::THandlerFunction timedHandler(const char* route, WebServer::THandlerFunction handler);
+void handleMetrics();
+
+// Function declarations from settings.ino
+Settings currentSettings();
+bool settingsEqual(const Settings& a, const Settings& b);
+void settingsBegin();
+void settingsWrite(const Settings& s);
+void serviceSettings();
+
+// Function declarations from spectrum_format.ino
+uint8_t* binPut8(uint8_t* p, uint8_t v);
+uint8_t* binPut16(uint8_t* p, uint16_t v);
+uint8_t* binPut32(uint8_t* p, uint32_t v);
+uint8_t* binPutFloat(uint8_t* p, float v);
+uint16_t binGet16(const uint8_t* p);
+uint16_t floatToHalf(float value);
+size_t encodeSpectrum(const SpectrumFrame& frame, uint8_t* out);
+
+// Function declarations from static_files.ino
+void staticFilesBegin();
+void handleStaticFile();
+
+// Function declarations from trace.ino
+void traceSpan(const char* name, const char* category, uint64_t startUs, float durationUs);
+uint64_t traceClockUs();
+uint32_t traceBegin();
+float traceEnd(uint32_t begin, const char* name, const char* category);
+void handleTrace();
+
+// Function declarations from websocket.ino
+void webSocketBegin();
+void serviceWebSocket();
 
 // Function declarations from web_handlers.ino
-void handleRoot();
-void handleConfig();
+bool notModified(const char* etag, const char* cacheControl = "no-cache");
+void serveAsset(const WebAsset& asset);
+void registerWebAssets();
 void handleSaveWifi();
 void handleStart();
+void handleDark();
+void handleContinuous();
+size_t dataJson(const SpectrumFrame& frame, char* out, size_t capacity);
+const char* cachedDataJson(size_t& len, uint32_t& scanId);
+const uint8_t* cachedDataBin(size_t& len, uint32_t& scanId);
 void handleData();
 void handleGetConfig();
 void handleSetConfig();
@@ -0,0 +1,184 @@
+#include "config.h"
+#include <Preferences.h>
+
+#define DARK_CACHE_SIZE 16
+
+// Dark offsets in raw counts per ADC, cached per SMUX group and exposure.
+// The sensor task only ever looks in the cache; flash is read and written
+// from loop(). requestScan() loads the references a scan starts with, and an
+// exposure the cache has not seen (auto exposure moved mid-scan) is queued
+// for serviceDark(). Misses are cached too, so flash is read at most once
+// for any given settings.
+struct DarkEntry {
+  bool used;
+  bool loaded; // false until loop() has looked it up in flash
+  bool valid;
+  bool dirty;  // captured but not yet written to flash
+  int group;
+  Exposure exposure;
+  float offsets[6];
+};
+
+DarkEntry darkCache[DARK_CACHE_SIZE];
+int darkCacheNext = 0;
+
+// The sensor task and loop() both update the cache
+portMUX_TYPE darkMux = portMUX_INITIALIZER_UNLOCKED;
+
+void darkKey(char* key, size_t len, int group, const Exposure& e) {
+  snprintf(key, len, "g%d%02x%02x%04x", group, e.gain, e.atime, e.astep);
+}
+
+int findDarkEntry(int group, const Exposure& e) {
+  for (int i = 0; i < DARK_CACHE_SIZE; i++) {
+    const DarkEntry& d = darkCache[i];
+    if (d.used && d.group == group && d.exposure.gain == e.gain &&
+        d.exposure.atime == e.atime && d.exposure.astep == e.astep) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Take the oldest slot that holds nothing unsaved, or return -1 when every
+// slot is still waiting to be written to flash. Call with darkMux held.
+int claimDarkEntry(int group, const Exposure& e) {
+  for (int i = 0; i < DARK_CACHE_SIZE; i++) {
+    int idx = (darkCacheNext + i) % DARK_CACHE_SIZE;
+    if (darkCache[idx].dirty) {
+      continue;
+    }
+    darkCacheNext = (idx + 1) % DARK_CACHE_SIZE;
+    DarkEntry& d = darkCache[idx];
+    d.used = true;
+    d.loaded = false;
+    d.valid = false;
+    d.dirty = false;
+    d.group = group;
+    d.exposure = e;
+    return idx;
+  }
+  return -1;
+}
+
+// Copy the dark offsets recorded for a group at these settings. Never
+// touches flash: DARK_PENDING means loop() has yet to load them.
+DarkLookup darkLookup(int group, const Exposure& e, float* offsets) {
+  DarkLookup result = DARK_NONE;
+  portENTER_CRITICAL(&darkMux);
+  int idx = findDarkEntry(group, e);
+  if (idx < 0) {
+    idx = claimDarkEntry(group, e);
+  }
+  if (idx >= 0) {
+    const DarkEntry& d = darkCache[idx];
+    if (!d.loaded) {
+      result = DARK_PENDING;
+    } else if (d.valid) {
+      memcpy(offsets, d.offsets, sizeof(d.offsets));
+      result = DARK_FOUND;
+    }
+  }
+  portEXIT_CRITICAL(&darkMux);
+  return result;
+}
+
+// Read one reference from flash into its cache entry, if it is still there
+// and still waiting
+void darkLoad(int group, const Exposure& e) {
+  char key[16];
+  darkKey(key, sizeof(key), group, e);
+  float offsets[6];
+  bool valid = false;
+  Preferences prefs;
+  if (prefs.begin("dark", true)) {
+    valid = prefs.getBytes(key, offsets, sizeof(offsets)) == sizeof(offsets);
+    prefs.end();
+  }
+
+  portENTER_CRITICAL(&darkMux);
+  int idx = findDarkEntry(group, e);
+  if (idx >= 0 && !darkCache[idx].loaded) {
+    DarkEntry& d = darkCache[idx];
+    d.loaded = true;
+    d.valid = valid;
+    if (valid) {
+      memcpy(d.offsets, offsets, sizeof(d.offsets));
+    }
+  }
+  portEXIT_CRITICAL(&darkMux);
+}
+
+// Make sure the reference for a group at these settings is cached. Runs on
+// the loop() side, before the scan that needs it starts.
+void darkPrefetch(int group, const Exposure& e) {
+  portENTER_CRITICAL(&darkMux);
+  int idx = findDarkEntry(group, e);
+  if (idx < 0) {
+    idx = claimDarkEntry(group, e);
+  }
+  bool loaded = idx < 0 || darkCache[idx].loaded;
+  portEXIT_CRITICAL(&darkMux);
+  if (!loaded) {
+    darkLoad(group, e);
+  }
+}
+
+// Offsets captured by a dark scan. They apply from the next lookup on;
+// serviceDark() writes them to flash. Returns false if every cache slot
+// still holds an unsaved reference.
+bool storeDark(int group, const Exposure& e, const float* offsets) {
+  portENTER_CRITICAL(&darkMux);
+  int idx = findDarkEntry(group, e);
+  if (idx < 0) {
+    idx = claimDarkEntry(group, e);
+  }
+  if (idx >= 0) {
+    DarkEntry& d = darkCache[idx];
+    memcpy(d.offsets, offsets, sizeof(d.offsets));
+    d.loaded = true;
+    d.valid = true;
+    d.dirty = true;
+  }
+  portEXIT_CRITICAL(&darkMux);
+  return idx >= 0;
+}
+
+// Called from loop(): load the references the sensor task missed and write
+// newly captured ones to flash
+void serviceDark() {
+  for (int i = 0; i < DARK_CACHE_SIZE; i++) {
+    portENTER_CRITICAL(&darkMux);
+    DarkEntry d = darkCache[i];
+    darkCache[i].dirty = false;
+    portEXIT_CRITICAL(&darkMux);
+    if (!d.used) {
+      continue;
+    }
+    if (d.dirty) {
+      char key[16];
+      darkKey(key, sizeof(key), d.group, d.exposure);
+      Preferences prefs;
+      if (prefs.begin("dark", false)) {
+        prefs.putBytes(key, d.offsets, sizeof(d.offsets));
+        prefs.end();
+      }
+    } else if (!d.loaded) {
+      darkLoad(d.group, d.exposure);
+    }
+  }
+}
+
+// Forget every stored dark reference. Only call while no scan is running.
+void clearDark() {
+  portENTER_CRITICAL(&darkMux);
+  for (int i = 0; i < DARK_CACHE_SIZE; i++) {
+    darkCache[i].used = false;
+    darkCache[i].dirty = false;
+  }
+  portEXIT_CRITICAL(&darkMux);
+  Preferences prefs;
+  prefs.begin("dark", false);
+  prefs.clear();
+  prefs.end();
+}
@@ -0,0 +1,136 @@
+#include "config.h"
+
+// Incremental OLED updates. Status lines, bars and the progress bar are only
+// redrawn when what they show changes, and only the 8-pixel pages they touch
+// are sent, limited to the columns of the visible window. A page is 73 bytes
+// on the bus instead of the 1 KB frame display.display() pushes.
+#define DISPLAY_FIELDS 4
+#define DISPLAY_FIELD_LEN 16
+#define DISPLAY_LINE_HEIGHT 8
+#define DISPLAY_BARS 8
+
+char displayFields[DISPLAY_FIELDS][DISPLAY_FIELD_LEN];
+uint8_t displayBarHeights[DISPLAY_BARS];
+int displayProgressWidth = 0;
+bool displayValid = false;
+uint8_t displayDirtyPages = 0; // bit n set when page n must be resent
+
+// Forget what is on screen; the next update redraws the whole window
+void displayInvalidate() {
+  displayValid = false;
+}
+
+// Mark the pages covering rows y..y+h-1 of the window for sending
+void displayMarkDirty(int y, int h) {
+  int first = (DISPLAY_OFFSET_Y + y) / 8;
+  int last = (DISPLAY_OFFSET_Y + y + h - 1) / 8;
+  for (int page = first; page <= last && page < SCREEN_HEIGHT / 8; page++) {
+    displayDirtyPages |= 1 << page;
+  }
+}
+
+// Start the incremental update of one frame
+void displayBegin() {
+  if (!displayValid) {
+    display.clearDisplay();
+    displayMarkDirty(0, USABLE_HEIGHT);
+  }
+  display.setTextSize(1);
+  display.setTextColor(SSD1306_WHITE);
+}
+
+// Show `text` on the line at window row y unless it is already there
+void displayField(int field, int y, const char* text) {
+  if (displayValid && strncmp(displayFields[field], text, DISPLAY_FIELD_LEN - 1) == 0) {
+    return;
+  }
+  strlcpy(displayFields[field], text, DISPLAY_FIELD_LEN);
+  display.fillRect(DISPLAY_OFFSET_X, DISPLAY_OFFSET_Y + y, USABLE_WIDTH, DISPLAY_LINE_HEIGHT, SSD1306_BLACK);
+  displayPrint(0, y, displayFields[field]);
+  displayMarkDirty(y, DISPLAY_LINE_HEIGHT);
+}
+
+// Bits of `page` that cover the absolute rows from..to-1
+uint8_t displayRowMask(int page, int from, int to) {
+  int lo = max(from - page * 8, 0);
+  int hi = min(to - page * 8, 8);
+  if (hi <= lo) return 0;
+  return (uint8_t)((0xFF << lo) & (0xFF >> (8 - hi)));
+}
+
+// Draw column x of the window area at rows y..y+h-1 straight into the
+// framebuffer, one byte per page: the bottom `lit` rows on, the rest off.
+void displayColumn(int x, int y, int h, int lit) {
+  uint8_t* buf = display.getBuffer();
+  int top = DISPLAY_OFFSET_Y + y;
+  int bottom = top + h;
+  for (int page = top / 8; page * 8 < bottom; page++) {
+    uint8_t& column = buf[page * SCREEN_WIDTH + DISPLAY_OFFSET_X + x];
+    column = (column & ~displayRowMask(page, top, bottom)) | displayRowMask(page, bottom - lit, bottom);
+  }
+}
+
+// Bar graph of DISPLAY_BARS values scaled to the largest, each bar one
+// column short of its slot so neighbours stay apart
+void displayBars(int y, int h, const float* values) {
+  float peak = 0;
+  for (int i = 0; i < DISPLAY_BARS; i++) {
+    peak = max(peak, values[i]);
+  }
+  int slot = USABLE_WIDTH / DISPLAY_BARS;
+  for (int i = 0; i < DISPLAY_BARS; i++) {
+    uint8_t height = peak > 0 ? (uint8_t)(max(values[i], 0.0f) / peak * h + 0.5f) : 0;
+    if (displayValid && height == displayBarHeights[i]) {
+      continue;
+    }
+    displayBarHeights[i] = height;
+    for (int x = i * slot; x < (i + 1) * slot - 1; x++) {
+      displayColumn(x, y, h, height);
+    }
+    displayMarkDirty(y, h);
+  }
+}
+
+// Progress bar across the window: filled up to `fraction`, a baseline after
+void displayProgress(int y, int h, float fraction) {
+  int width = (int)(constrain(fraction, 0.0f, 1.0f) * USABLE_WIDTH);
+  if (displayValid && width == displayProgressWidth) {
+    return;
+  }
+  displayProgressWidth = width;
+  for (int x = 0; x < USABLE_WIDTH; x++) {
+    displayColumn(x, y, h, x < width ? h : 1);
+  }
+  displayMarkDirty(y, h);
+}
+
+// Send the window's columns of one page from the framebuffer
+void displaySendPage(uint8_t page) {
+  Wire1.beginTransmission(SCREEN_ADDRESS);
+  Wire1.write((uint8_t)0x00); // command stream
+  Wire1.write((uint8_t)SSD1306_PAGEADDR);
+  Wire1.write(page);
+  Wire1.write(page);
+  Wire1.write((uint8_t)SSD1306_COLUMNADDR);
+  Wire1.write((uint8_t)DISPLAY_OFFSET_X);
+  Wire1.write((uint8_t)(DISPLAY_OFFSET_X + USABLE_WIDTH - 1));
+  if (!i2cCheck(I2C_BUS_OLED, Wire1.endTransmission() == 0)) {
+    return;
+  }
+
+  Wire1.beginTransmission(SCREEN_ADDRESS);
+  Wire1.write((uint8_t)0x40); // data stream
+  Wire1.write(display.getBuffer() + page * SCREEN_WIDTH + DISPLAY_OFFSET_X, USABLE_WIDTH);
+  i2cCheck(I2C_BUS_OLED, Wire1.endTransmission() == 0);
+}
+
+// Send the pages changed since the last flush
+void displayFlush() {
+  for (uint8_t page = 0; page < SCREEN_HEIGHT / 8; page++) {
+    if (displayDirtyPages & (1 << page)) {
+      displaySendPage(page);
+    }
+  }
+  displayDirtyPages = 0;
+  displayValid = true;
+}
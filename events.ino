@@ -0,0 +1,203 @@
+#include "config.h"
+#include <lwip/sockets.h>
+#include <errno.h>
+
+// Server-Sent Events stream at /events. Each subscriber is a copy of the
+// WebServer's client socket that stays open after the handler returns; loop()
+// pushes completed scans and progress to all of them.
+#define EVENTS_MAX_CLIENTS 4
+#define EVENTS_PROGRESS_INTERVAL 500 // ms between progress events while scanning
+#define EVENTS_KEEPALIVE_INTERVAL 15000
+#define EVENTS_STALL_TIMEOUT 5000 // ms without progress before a subscriber is dropped
+
+// Sockets are written without waiting, since WiFiClient::write() retries for
+// seconds while the send buffer is full. What the socket does not take is
+// kept per subscriber and sent from loop() as the buffer drains. Progress
+// and keepalive events are skipped while a message is in flight; a scan is
+// sent once it has drained.
+EventClient eventClients[EVENTS_MAX_CLIENTS];
+uint32_t eventsSentScanId = 0;
+unsigned long lastProgressEvent = 0;
+unsigned long lastKeepalive = 0;
+bool lastEventCollecting = false;
+
+void eventsDrop(EventClient& c) {
+  c.client.stop();
+  c.pendingLen = 0;
+  c.scanOwed = false;
+}
+
+// Send what the socket takes right now. Returns the bytes sent, or -1 after
+// dropping a subscriber whose connection failed.
+int eventsSend(EventClient& c, const char* data, size_t len) {
+  int fd = c.client.connected() ? c.client.fd() : -1;
+  ssize_t sent = fd >= 0 ? send(fd, data, len, MSG_DONTWAIT) : -1;
+  if (sent < 0 && fd >= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    sent = 0;
+  }
+  if (sent < 0) {
+    eventsDrop(c);
+    return -1;
+  }
+  if (sent > 0) {
+    c.lastProgress = millis();
+  }
+  return sent;
+}
+
+// Send part of a message, or queue it behind what is still pending
+void eventsWrite(EventClient& c, const char* data, size_t len) {
+  if (!c.client) {
+    return;
+  }
+  size_t sent = 0;
+  if (c.pendingLen == 0) {
+    int n = eventsSend(c, data, len);
+    if (n < 0) {
+      return;
+    }
+    sent = n;
+    c.lastProgress = millis();
+  }
+  size_t rest = len - sent;
+  if (rest > EVENTS_PENDING_SIZE - c.pendingLen) {
+    eventsDrop(c);
+    return;
+  }
+  memcpy(c.pending + c.pendingLen, data + sent, rest);
+  c.pendingLen += rest;
+}
+
+// Progress and keepalive events go only to subscribers with nothing in flight
+void eventsBroadcast(const char* data, size_t len) {
+  for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    if (eventClients[i].client && eventClients[i].pendingLen == 0) {
+      eventsWrite(eventClients[i], data, len);
+    }
+  }
+}
+
+int statusEvent(char* buf, size_t len) {
+  return snprintf(buf, len,
+                  "event: status\ndata: {\"state\":\"%s\",\"scanId\":%lu,\"completedScanId\":%lu,"
+                  "\"progress\":%.3f,\"continuous\":%s,\"elapsedTime\":%lu}\n\n",
+                  acquisitionStateName(), (unsigned long)currentScanId, (unsigned long)completedScanId,
+                  acquisitionProgress(), continuousMode ? "true" : "false",
+                  collecting ? millis() - scanStartTime : scanElapsedTime);
+}
+
+// Send the latest scan to one subscriber, or to all of them when c is NULL.
+// The payload is the cached /data JSON, which never contains newlines.
+void eventsSendScan(EventClient* c) {
+  size_t len;
+  uint32_t scanId;
+  const char* json = cachedDataJson(len, scanId);
+  if (len == 0 || scanId == 0) {
+    return;
+  }
+  char head[48];
+  int headLen = snprintf(head, sizeof(head), "id: %lu\nevent: scan\ndata: ", (unsigned long)scanId);
+  for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    EventClient& target = c ? *c : eventClients[i];
+    if (target.client && target.pendingLen > 0) {
+      target.scanOwed = true;
+    } else if (target.client) {
+      eventsWrite(target, head, headLen);
+      eventsWrite(target, json, len);
+      eventsWrite(target, "\n\n", 2);
+    }
+    if (c) break;
+  }
+}
+
+// Push out pending bytes; drop subscribers that made no progress for
+// EVENTS_STALL_TIMEOUT and send owed scans to the ones that drained
+void eventsFlush() {
+  for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    EventClient& c = eventClients[i];
+    if (!c.client || c.pendingLen == 0) {
+      continue;
+    }
+    int sent = eventsSend(c, c.pending, c.pendingLen);
+    if (sent < 0) {
+      continue;
+    }
+    c.pendingLen -= sent;
+    memmove(c.pending, c.pending + sent, c.pendingLen);
+    if (c.pendingLen > 0) {
+      if (millis() - c.lastProgress >= EVENTS_STALL_TIMEOUT) {
+        eventsDrop(c);
+      }
+    } else if (c.scanOwed) {
+      c.scanOwed = false;
+      eventsSendScan(&c);
+    }
+  }
+}
+
+int eventsSubscriberCount() {
+  int count = 0;
+  for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    if (eventClients[i].client) count++;
+  }
+  return count;
+}
+
+// GET /events: keep the connection and bring the new subscriber up to date
+void handleEvents() {
+  int slot = -1;
+  for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    if (!eventClients[i].client || !eventClients[i].client.connected()) {
+      eventsDrop(eventClients[i]);
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    server.send(503, "text/plain", "Too many event subscribers.");
+    return;
+  }
+
+  EventClient& c = eventClients[slot];
+  c.client = server.client();
+  const char* headers = "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/event-stream\r\n"
+                        "Cache-Control: no-cache\r\n"
+                        "Connection: keep-alive\r\n"
+                        "Access-Control-Allow-Origin: *\r\n\r\n"
+                        "retry: 2000\n\n";
+  eventsWrite(c, headers, strlen(headers));
+
+  char buf[192];
+  eventsWrite(c, buf, statusEvent(buf, sizeof(buf)));
+  eventsSendScan(&c);
+}
+
+// Called from loop(). Each completed scan is serialized once, shared with /data.
+void serviceEvents() {
+  if (eventsSubscriberCount() == 0) {
+    eventsSentScanId = completedScanId;
+    return;
+  }
+  eventsFlush();
+  char buf[192];
+  unsigned long now = millis();
+  bool active = collecting;
+
+  if (completedScanId != eventsSentScanId) {
+    eventsSentScanId = completedScanId;
+    if (latestSpectrumId() == completedScanId) { // dark scans are not published
+      eventsSendScan(NULL);
+    }
+    eventsBroadcast(buf, statusEvent(buf, sizeof(buf)));
+    lastProgressEvent = now;
+  } else if (active != lastEventCollecting ||
+             (active && now - lastProgressEvent >= EVENTS_PROGRESS_INTERVAL)) {
+    eventsBroadcast(buf, statusEvent(buf, sizeof(buf)));
+    lastProgressEvent = now;
+  } else if (now - lastKeepalive >= EVENTS_KEEPALIVE_INTERVAL) {
+    eventsBroadcast(": keepalive\n\n", 13);
+    lastKeepalive = now;
+  }
+  lastEventCollecting = active;
+}
@@ -0,0 +1,107 @@
+#include "config.h"
+
+// Auto-exposure limits. ATIME stays at sensorAtime; the controller moves the
+// gain first and only stretches or shortens ASTEP once the gain is pinned.
+#define AE_GAIN_MAX 10
+#define AE_ASTEP_MIN 99
+#define AE_ASTEP_MAX 2999
+#define AE_SATURATION_FRACTION 0.9f
+
+// The long exposure of an HDR bracket collects 2^HDR_BRACKET_STEPS times the
+// signal of the auto-exposed short one
+#define HDR_BRACKET_STEPS 4
+
+// Exposure used for the next measurement of each SMUX group
+Exposure groupExposure[2];
+
+// AGAIN register value n selects a gain of 0.5x * 2^n
+float as7341GainFactor(uint8_t gain) {
+  return gain == 0 ? 0.5f : (float)(1UL << (gain - 1));
+}
+
+// Highest count the ADCs can report: one count per integration step
+uint16_t as7341FullScale(const Exposure& e) {
+  unsigned long steps = (unsigned long)(e.atime + 1) * (e.astep + 1);
+  return steps > 65535 ? 65535 : steps;
+}
+
+// Integration time of one measurement: (ATIME + 1) * (ASTEP + 1) * 2.78us
+unsigned long as7341IntegrationTimeUs(const Exposure& e) {
+  return (unsigned long)(e.atime + 1) * (e.astep + 1) * 278 / 100;
+}
+
+// Raw ADC counts normalized by gain and integration time (AMS "basic counts")
+float toBasicCounts(float counts, const Exposure& e) {
+  return counts / (as7341GainFactor(e.gain) * (as7341IntegrationTimeUs(e) / 1000.0f));
+}
+
+// Put both groups back on the manual settings from /setconfig
+void resetExposure() {
+  for (int g = 0; g < 2; g++) {
+    groupExposure[g].gain = sensorGain;
+    groupExposure[g].atime = sensorAtime;
+    groupExposure[g].astep = sensorAstep;
+  }
+}
+
+// Scale the signal an exposure collects by 2^steps, moving the gain first and
+// spilling whatever the gain range cannot absorb into ASTEP, kept within
+// astepMin..astepMax. The result never moves against the requested direction,
+// even when e starts outside that range.
+Exposure scaleExposure(const Exposure& e, int steps, uint16_t astepMin, uint16_t astepMax) {
+  Exposure scaled = e;
+  int gain = constrain((int)e.gain + steps, 0, AE_GAIN_MAX);
+  steps -= gain - e.gain;
+  scaled.gain = gain;
+
+  if (steps > 0) {
+    long astep = min((long)(e.astep + 1) << min(steps, 8), (long)astepMax + 1) - 1;
+    scaled.astep = max(astep, (long)e.astep);
+  } else if (steps < 0) {
+    long astep = max((long)(e.astep + 1) >> min(-steps, 8), (long)astepMin + 1) - 1;
+    scaled.astep = min(astep, (long)e.astep);
+  }
+  return scaled;
+}
+
+// The long bracket is not bound by the auto-exposure range, only by what the
+// sensor accepts, so it stays longer than a manual short exposure
+Exposure hdrLongExposure(const Exposure& e) {
+  return scaleExposure(e, HDR_BRACKET_STEPS, e.astep, SENSOR_ASTEP_MAX);
+}
+
+// True if a collects more signal than b
+bool exposureLonger(const Exposure& a, const Exposure& b) {
+  return as7341GainFactor(a.gain) * as7341IntegrationTimeUs(a) > as7341GainFactor(b.gain) * as7341IntegrationTimeUs(b);
+}
+
+// A channel is clipped when it reaches digital full scale. Analog saturation
+// is only flagged for the whole group, so it is pinned on the brightest channel.
+bool channelSaturated(uint16_t count, uint16_t peak, uint8_t astatus, const Exposure& e) {
+  if (count >= as7341FullScale(e)) {
+    return true;
+  }
+  return (astatus & AS7341_ASTATUS_ASAT) && count == peak;
+}
+
+// Steer the exposure so the brightest channel of a group lands near
+// exposureTarget of full scale. Returns true if the settings were changed.
+bool adjustExposure(Exposure& e, uint16_t peak, bool saturated) {
+  uint16_t fullScale = as7341FullScale(e);
+  int steps; // doublings of signal wanted, negative to darken
+
+  if (saturated || peak >= AE_SATURATION_FRACTION * fullScale) {
+    steps = -2;
+  } else {
+    float ratio = exposureTarget * fullScale / max(peak, (uint16_t)1);
+    if (ratio >= 0.5f && ratio <= 2.0f) {
+      return false;
+    }
+    steps = (int)lroundf(log2f(ratio));
+  }
+
+  Exposure scaled = scaleExposure(e, steps, AE_ASTEP_MIN, AE_ASTEP_MAX);
+  bool changed = (scaled.gain != e.gain) || (scaled.astep != e.astep);
+  e = scaled;
+  return changed;
+}
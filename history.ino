@@ -0,0 +1,126 @@
+#include "config.h"
+
+// Scan history ring buffer. Placed in PSRAM when the board has it, otherwise
+// a much smaller buffer comes out of the internal heap.
+#define HISTORY_CAPACITY_PSRAM 4096
+#define HISTORY_CAPACITY_HEAP 256
+#define HISTORY_DEFAULT_LIMIT 100
+#define HISTORY_MAX_LIMIT 500
+
+ScanRecord* history = NULL;
+uint32_t historyCapacity = 0;
+uint32_t historyTotal = 0; // records ever appended; the next one goes to historyTotal % capacity
+portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+
+void historyBegin() {
+  if (psramFound()) {
+    history = (ScanRecord*)ps_calloc(HISTORY_CAPACITY_PSRAM, sizeof(ScanRecord));
+    historyCapacity = HISTORY_CAPACITY_PSRAM;
+  }
+  if (history == NULL) {
+    history = (ScanRecord*)calloc(HISTORY_CAPACITY_HEAP, sizeof(ScanRecord));
+    historyCapacity = history != NULL ? HISTORY_CAPACITY_HEAP : 0;
+  }
+  Serial.print("Scan history capacity: ");
+  Serial.println(historyCapacity);
+}
+
+// Called by the sensor task for every published scan
+void historyAppend(const SpectrumFrame& frame) {
+  if (historyCapacity == 0) {
+    return;
+  }
+  ScanRecord record;
+  record.seq = frame.scanId;
+  record.timestamp = frame.startTime;
+  record.elapsedMs = frame.elapsedTime;
+  record.readingCount = frame.readingCount;
+  record.saturatedMask = 0;
+  for (int i = 0; i < 10; i++) {
+    if (frame.saturated[i]) record.saturatedMask |= 1 << i;
+  }
+  record.exposure[0] = frame.exposure[0];
+  record.exposure[1] = frame.exposure[1];
+  memcpy(record.readings, frame.readings, sizeof(record.readings));
+
+  portENTER_CRITICAL(&historyMux);
+  history[historyTotal % historyCapacity] = record;
+  historyTotal++;
+  portEXIT_CRITICAL(&historyMux);
+}
+
+// Copy the index-th record ever appended. Returns false if it has not been
+// written yet or has already been overwritten.
+bool historyRead(uint32_t index, ScanRecord& out) {
+  bool ok;
+  portENTER_CRITICAL(&historyMux);
+  uint32_t total = historyTotal;
+  uint32_t oldest = total > historyCapacity ? total - historyCapacity : 0;
+  ok = (index >= oldest) && (index < total);
+  if (ok) {
+    out = history[index % historyCapacity];
+  }
+  portEXIT_CRITICAL(&historyMux);
+  return ok;
+}
+
+// Records are appended in scan order, so find the first one after `since`
+// with a binary search over the retained window.
+uint32_t historyFindAfter(uint32_t since, uint32_t oldest, uint32_t total) {
+  uint32_t lo = oldest;
+  uint32_t hi = total;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    ScanRecord record;
+    if (!historyRead(mid, record) || record.seq <= since) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// GET /history?since=<seq>&limit=<n>: retained scans with seq > since, oldest first
+void handleHistory() {
+  uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), NULL, 10) : 0;
+  uint32_t limit = server.hasArg("limit") ? strtoul(server.arg("limit").c_str(), NULL, 10) : HISTORY_DEFAULT_LIMIT;
+  if (limit < 1) limit = 1;
+  if (limit > HISTORY_MAX_LIMIT) limit = HISTORY_MAX_LIMIT;
+
+  portENTER_CRITICAL(&historyMux);
+  uint32_t total = historyTotal;
+  portEXIT_CRITICAL(&historyMux);
+  uint32_t oldest = total > historyCapacity ? total - historyCapacity : 0;
+  uint32_t first = historyFindAfter(since, oldest, total);
+  uint32_t count = min(total - first, limit);
+
+  char buf[512];
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  snprintf(buf, sizeof(buf), "{\"capacity\":%lu,\"now\":%lu,\"more\":%s,\"entries\":[",
+           (unsigned long)historyCapacity, millis(), (first + count < total) ? "true" : "false");
+  server.sendContent(buf);
+
+  bool firstEntry = true;
+  for (uint32_t i = 0; i < count; i++) {
+    ScanRecord r;
+    if (!historyRead(first + i, r)) {
+      continue; // overwritten while we were sending
+    }
+    int len = snprintf(buf, sizeof(buf),
+                       "%s{\"seq\":%lu,\"t\":%lu,\"elapsed\":%lu,\"samples\":%u,\"saturated\":%u,"
+                       "\"gain\":[%u,%u],\"atime\":[%u,%u],\"astep\":[%u,%u],\"raw\":[",
+                       firstEntry ? "" : ",", (unsigned long)r.seq, (unsigned long)r.timestamp,
+                       (unsigned long)r.elapsedMs, r.readingCount, r.saturatedMask,
+                       r.exposure[0].gain, r.exposure[1].gain, r.exposure[0].atime, r.exposure[1].atime,
+                       r.exposure[0].astep, r.exposure[1].astep);
+    for (int ch = 0; ch < 10; ch++) {
+      len += snprintf(buf + len, sizeof(buf) - len, ch < 9 ? "%.6g," : "%.6g]}", r.readings[ch]);
+    }
+    server.sendContent(buf, len);
+    firstEntry = false;
+  }
+  server.sendContent("]}");
+  server.sendContent("");
+}
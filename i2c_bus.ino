@@ -0,0 +1,88 @@
+#include "config.h"
+#include <Wire.h>
+
+// Clock rate of each I2C bus, set through /setconfig and persisted with the
+// other settings. A bus that keeps failing (NACK or timeout) steps down to
+// the next slower rate until the next boot; the configured rate stays stored.
+#define I2C_FALLBACK_ERRORS 3
+
+struct I2cBus {
+  TwoWire* wire;
+  const char* name; // label in /metrics
+  uint32_t configured;
+  uint32_t active;
+  uint32_t errors;
+  uint8_t consecutiveErrors;
+};
+
+// Both start in fast mode. Fast-mode plus depends on the pull-ups and wiring
+// of the board, so it is opt-in; the fallback catches boards that cannot.
+I2cBus i2cBuses[I2C_BUS_COUNT] = {
+  {&Wire, "sensor", I2C_CLOCK_FAST, I2C_CLOCK_FAST, 0, 0},
+  {&Wire1, "oled", I2C_CLOCK_FAST, I2C_CLOCK_FAST, 0, 0},
+};
+
+// Standard, fast and fast-mode plus; the ESP32 controllers go no higher
+bool i2cClockValid(uint32_t hz) {
+  return hz == I2C_CLOCK_STANDARD || hz == I2C_CLOCK_FAST || hz == I2C_CLOCK_FAST_PLUS;
+}
+
+// Rate to start a bus at, before it is begun
+void i2cInitClock(int bus, uint32_t hz) {
+  if (i2cClockValid(hz)) {
+    i2cBuses[bus].configured = hz;
+    i2cBuses[bus].active = hz;
+  }
+}
+
+uint32_t i2cClock(int bus) {
+  return i2cBuses[bus].active;
+}
+
+uint32_t i2cConfiguredClock(int bus) {
+  return i2cBuses[bus].configured;
+}
+
+uint32_t i2cErrors(int bus) {
+  return i2cBuses[bus].errors;
+}
+
+const char* i2cBusName(int bus) {
+  return i2cBuses[bus].name;
+}
+
+// Apply a new rate to a running bus. The caller must own the bus (i2cMutex
+// for the sensor bus).
+bool setI2cClock(int bus, uint32_t hz) {
+  if (!i2cClockValid(hz)) {
+    return false;
+  }
+  I2cBus& b = i2cBuses[bus];
+  b.configured = hz;
+  b.active = hz;
+  b.consecutiveErrors = 0;
+  b.wire->setClock(hz);
+  return true;
+}
+
+// Record the outcome of a transaction and step the clock down after
+// I2C_FALLBACK_ERRORS failures in a row. Returns ok.
+bool i2cCheck(int bus, bool ok) {
+  I2cBus& b = i2cBuses[bus];
+  if (ok) {
+    b.consecutiveErrors = 0;
+    return true;
+  }
+  b.errors++;
+  if (++b.consecutiveErrors >= I2C_FALLBACK_ERRORS && b.active > I2C_CLOCK_STANDARD) {
+    b.active = b.active > I2C_CLOCK_FAST ? I2C_CLOCK_FAST : I2C_CLOCK_STANDARD;
+    b.consecutiveErrors = 0;
+    b.wire->setClock(b.active);
+    Serial.print("I2C ");
+    Serial.print(b.name);
+    Serial.print(" bus errors, falling back to ");
+    Serial.print(b.active / 1000);
+    Serial.println(" kHz");
+  }
+  return false;
+}
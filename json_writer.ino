@@ -0,0 +1,97 @@
+#include "config.h"
+
+// Minimal JSON output into a caller-owned buffer, for responses that are
+// built often enough that String concatenation would churn the heap. Output
+// that does not fit is dropped and marks the writer as overflowed.
+
+void jsonBegin(JsonWriter& w, char* buf, size_t capacity) {
+  w.buf = buf;
+  w.capacity = capacity;
+  w.len = 0;
+  w.overflow = false;
+  if (capacity > 0) buf[0] = '\0';
+}
+
+void jsonWrite(JsonWriter& w, const char* text, size_t n) {
+  if (w.len + n >= w.capacity) {
+    w.overflow = true;
+    return;
+  }
+  memcpy(w.buf + w.len, text, n);
+  w.len += n;
+  w.buf[w.len] = '\0';
+}
+
+void jsonRaw(JsonWriter& w, const char* text) {
+  jsonWrite(w, text, strlen(text));
+}
+
+void jsonBool(JsonWriter& w, bool value) {
+  jsonRaw(w, value ? "true" : "false");
+}
+
+// Quoted string with quotes, backslashes and control characters escaped
+void jsonString(JsonWriter& w, const char* text) {
+  jsonWrite(w, "\"", 1);
+  const char* run = text;
+  for (const char* p = text; *p; p++) {
+    unsigned char c = *p;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    jsonWrite(w, run, p - run);
+    char escape[8];
+    if (c == '"' || c == '\\') {
+      escape[0] = '\\';
+      escape[1] = c;
+      jsonWrite(w, escape, 2);
+    } else {
+      jsonWrite(w, escape, snprintf(escape, sizeof(escape), "\\u%04x", c));
+    }
+    run = p + 1;
+  }
+  jsonRaw(w, run);
+  jsonWrite(w, "\"", 1);
+}
+
+void jsonUInt(JsonWriter& w, uint32_t value) {
+  char digits[10];
+  int n = 0;
+  do {
+    digits[sizeof(digits) - 1 - n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  jsonWrite(w, digits + sizeof(digits) - n, n);
+}
+
+// Fixed-point formatting with `decimals` fractional digits, same output as
+// String(value, decimals) but without the allocation or a printf round trip.
+// NaN and infinity are not valid JSON and come out as null.
+void jsonFixed(JsonWriter& w, float value, int decimals) {
+  static const uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+  if (isnan(value) || isinf(value)) {
+    jsonRaw(w, "null");
+    return;
+  }
+  decimals = constrain(decimals, 0, 6);
+  // Scaled in double: a float mantissa cannot hold 6 decimals of a 3-digit value
+  double magnitude = fabs((double)value) * powers[decimals] + 0.5;
+  if (magnitude >= 4.0e9) {
+    char tmp[56];
+    jsonWrite(w, tmp, snprintf(tmp, sizeof(tmp), "%.*f", decimals, value));
+    return;
+  }
+  uint32_t scaled = (uint32_t)magnitude;
+  if (value < 0 && scaled > 0) jsonWrite(w, "-", 1);
+  jsonUInt(w, scaled / powers[decimals]);
+  if (decimals > 0) {
+    char frac[8];
+    uint32_t rest = scaled % powers[decimals];
+    frac[0] = '.';
+    for (int i = decimals; i > 0; i--) {
+      frac[i] = '0' + rest % 10;
+      rest /= 10;
+    }
+    jsonWrite(w, frac, decimals + 1);
+  }
+}
@@ -0,0 +1,187 @@
+#include "config.h"
+
+// Counters and latency histograms served at /metrics in the Prometheus text
+// exposition format. Durations are recorded in microseconds into fixed
+// buckets and reported in seconds.
+#define METRICS_MAX_ROUTES 32
+#define METRICS_CHUNK 2048
+
+// Upper bounds of all but the last (+Inf) bucket
+const uint32_t metricsBoundsUs[METRICS_BUCKETS - 1] = {
+  100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000
+};
+const char* const metricsBoundLabels[METRICS_BUCKETS] = {
+  "0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "0.5", "1", "+Inf"
+};
+
+struct RouteMetrics {
+  const char* route;
+  LatencyHistogram latency;
+};
+
+RouteMetrics routeMetrics[METRICS_MAX_ROUTES];
+int routeMetricsCount = 0;
+
+LatencyHistogram i2cLatency;
+LatencyHistogram interpolationLatency;
+LatencyHistogram serializeJsonLatency;
+LatencyHistogram serializeBinLatency;
+LatencyHistogram displayLatency;
+
+// The sensor task records from the other core while loop() serves /metrics
+portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+void metricsObserve(LatencyHistogram& h, uint32_t us) {
+  int i = 0;
+  while (i < METRICS_BUCKETS - 1 && us > metricsBoundsUs[i]) i++;
+  portENTER_CRITICAL(&metricsMux);
+  h.buckets[i]++;
+  h.count++;
+  h.sumUs += us;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+// Wrap a route handler so its run time, response included, is recorded
+// under `route` and traced. Routes beyond METRICS_MAX_ROUTES are served untimed.
+WebServer::THandlerFunction timedHandler(const char* route, WebServer::THandlerFunction handler) {
+  if (routeMetricsCount >= METRICS_MAX_ROUTES) {
+    return handler;
+  }
+  RouteMetrics* metrics = &routeMetrics[routeMetricsCount++];
+  metrics->route = route;
+  return [metrics, handler]() {
+    uint32_t span = traceBegin();
+    handler();
+    metricsObserve(metrics->latency, traceEnd(span, metrics->route, "http"));
+  };
+}
+
+void metricsFlush(JsonWriter& w) {
+  server.sendContent(w.buf, w.len);
+  jsonBegin(w, w.buf, w.capacity);
+}
+
+void metricsSeconds(JsonWriter& w, uint64_t us) {
+  char frac[8];
+  jsonUInt(w, us / 1000000);
+  jsonWrite(w, frac, snprintf(frac, sizeof(frac), ".%06lu", (unsigned long)(us % 1000000)));
+}
+
+void metricsHeader(JsonWriter& w, const char* name, const char* type, const char* help) {
+  jsonRaw(w, "# HELP ");
+  jsonRaw(w, name);
+  jsonRaw(w, " ");
+  jsonRaw(w, help);
+  jsonRaw(w, "\n# TYPE ");
+  jsonRaw(w, name);
+  jsonRaw(w, " ");
+  jsonRaw(w, type);
+  jsonRaw(w, "\n");
+}
+
+void metricsValue(JsonWriter& w, const char* name, const char* type, const char* help, long value) {
+  char digits[16];
+  metricsHeader(w, name, type, help);
+  jsonRaw(w, name);
+  jsonRaw(w, " ");
+  jsonWrite(w, digits, snprintf(digits, sizeof(digits), "%ld", value));
+  jsonRaw(w, "\n");
+}
+
+void metricsBusValue(JsonWriter& w, const char* name, int bus, uint32_t value) {
+  jsonRaw(w, name);
+  jsonRaw(w, "{bus=\"");
+  jsonRaw(w, i2cBusName(bus));
+  jsonRaw(w, "\"} ");
+  jsonUInt(w, value);
+  jsonRaw(w, "\n");
+}
+
+// One histogram series; `labels` is a label list without braces, or NULL
+void metricsHistogram(JsonWriter& w, const char* name, const char* labels, const LatencyHistogram& live) {
+  LatencyHistogram h;
+  portENTER_CRITICAL(&metricsMux);
+  h = live;
+  portEXIT_CRITICAL(&metricsMux);
+
+  uint32_t cumulative = 0;
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    jsonRaw(w, name);
+    jsonRaw(w, "_bucket{");
+    if (labels != NULL) {
+      jsonRaw(w, labels);
+      jsonRaw(w, ",");
+    }
+    jsonRaw(w, "le=\"");
+    jsonRaw(w, metricsBoundLabels[i]);
+    jsonRaw(w, "\"} ");
+    jsonUInt(w, cumulative);
+    jsonRaw(w, "\n");
+  }
+  const char* open = labels != NULL ? "{" : "";
+  const char* close = labels != NULL ? "} " : " ";
+  jsonRaw(w, name);
+  jsonRaw(w, "_sum");
+  jsonRaw(w, open);
+  if (labels != NULL) jsonRaw(w, labels);
+  jsonRaw(w, close);
+  metricsSeconds(w, h.sumUs);
+  jsonRaw(w, "\n");
+  jsonRaw(w, name);
+  jsonRaw(w, "_count");
+  jsonRaw(w, open);
+  if (labels != NULL) jsonRaw(w, labels);
+  jsonRaw(w, close);
+  jsonUInt(w, h.count);
+  jsonRaw(w, "\n");
+  metricsFlush(w);
+}
+
+void handleMetrics() {
+  static char buf[METRICS_CHUNK];
+  JsonWriter w;
+  jsonBegin(w, buf, sizeof(buf));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  metricsHeader(w, "tricorder_http_request_duration_seconds", "histogram", "Time spent in each HTTP route handler.");
+  for (int i = 0; i < routeMetricsCount; i++) {
+    char labels[64];
+    snprintf(labels, sizeof(labels), "route=\"%s\"", routeMetrics[i].route);
+    metricsHistogram(w, "tricorder_http_request_duration_seconds", labels, routeMetrics[i].latency);
+  }
+  metricsHeader(w, "tricorder_i2c_transaction_seconds", "histogram", "Sensor bus time per acquisition step.");
+  metricsHistogram(w, "tricorder_i2c_transaction_seconds", NULL, i2cLatency);
+  metricsHeader(w, "tricorder_interpolation_seconds", "histogram", "Time to interpolate one scan.");
+  metricsHistogram(w, "tricorder_interpolation_seconds", NULL, interpolationLatency);
+  metricsHeader(w, "tricorder_serialization_seconds", "histogram", "Time to encode one scan for /data.");
+  metricsHistogram(w, "tricorder_serialization_seconds", "format=\"json\"", serializeJsonLatency);
+  metricsHistogram(w, "tricorder_serialization_seconds", "format=\"bin\"", serializeBinLatency);
+  metricsHeader(w, "tricorder_display_refresh_seconds", "histogram", "Time to redraw the OLED.");
+  metricsHistogram(w, "tricorder_display_refresh_seconds", NULL, displayLatency);
+
+  metricsHeader(w, "tricorder_i2c_errors_total", "counter", "Failed I2C transactions (NACK or timeout).");
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    metricsBusValue(w, "tricorder_i2c_errors_total", i, i2cErrors(i));
+  }
+  metricsHeader(w, "tricorder_i2c_clock_hz", "gauge", "Current I2C clock, lower than configured after a fallback.");
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    metricsBusValue(w, "tricorder_i2c_clock_hz", i, i2cClock(i));
+  }
+
+  static SpectrumFrame frame;
+  readLatestSpectrum(frame);
+  metricsValue(w, "tricorder_scans_total", "counter", "Scans completed since boot.", completedScanId);
+  metricsValue(w, "tricorder_acquisition_timeouts_total", "counter", "Sensor measurements that never completed.", acquisitionTimeouts);
+  metricsValue(w, "tricorder_scan_samples", "gauge", "Samples accumulated in the latest scan.", frame.readingCount);
+  metricsValue(w, "tricorder_heap_free_bytes", "gauge", "Free heap.", ESP.getFreeHeap());
+  metricsValue(w, "tricorder_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.", ESP.getMaxAllocHeap());
+  metricsValue(w, "tricorder_heap_min_free_bytes", "gauge", "Lowest free heap since boot.", ESP.getMinFreeHeap());
+  if (!apMode && WiFi.status() == WL_CONNECTED) {
+    metricsValue(w, "tricorder_wifi_rssi_dbm", "gauge", "Signal strength of the WiFi connection.", WiFi.RSSI());
+  }
+  metricsValue(w, "tricorder_uptime_seconds", "gauge", "Time since boot.", millis() / 1000);
+  metricsFlush(w);
+  server.sendContent("");
+}
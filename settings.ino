@@ -0,0 +1,110 @@
+#include "config.h"
+#include <Preferences.h>
+
+// Every tunable is loaded from NVS once at boot. Afterwards loop() compares
+// the live values with what was last stored and, SETTINGS_DEBOUNCE_MS after
+// the last change, writes only the keys that differ. A burst of /setconfig
+// calls from the UI thus costs one NVS commit.
+#define SETTINGS_DEBOUNCE_MS 2000
+
+Settings storedSettings;  // what NVS holds
+Settings pendingSettings; // live values as of the last change
+unsigned long settingsChangedAt = 0;
+
+Settings currentSettings() {
+  Settings s;
+  s.accumulationTime = accumulationTime;
+  s.scanInterval = scanInterval;
+  s.autoExposure = autoExposure;
+  s.exposureTarget = exposureTarget;
+  s.hdr = hdrMode;
+  s.continuous = continuousMode;
+  s.gain = sensorGain;
+  s.atime = sensorAtime;
+  s.astep = sensorAstep;
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    s.i2cClock[i] = i2cConfiguredClock(i);
+  }
+  return s;
+}
+
+bool settingsEqual(const Settings& a, const Settings& b) {
+  return a.accumulationTime == b.accumulationTime && a.scanInterval == b.scanInterval &&
+         a.autoExposure == b.autoExposure && a.exposureTarget == b.exposureTarget &&
+         a.hdr == b.hdr && a.continuous == b.continuous &&
+         a.gain == b.gain && a.atime == b.atime && a.astep == b.astep &&
+         a.i2cClock[I2C_BUS_SENSOR] == b.i2cClock[I2C_BUS_SENSOR] &&
+         a.i2cClock[I2C_BUS_OLED] == b.i2cClock[I2C_BUS_OLED];
+}
+
+// Load the stored settings over the compiled-in defaults. Call first thing
+// in setup(), before the I2C buses and the sensor are started.
+void settingsBegin() {
+  Settings s = currentSettings();
+  Preferences prefs;
+  if (prefs.begin("settings", true)) {
+    s.accumulationTime = constrain(prefs.getUShort("accTime", s.accumulationTime), 1, ACCUMULATION_TIME_MAX);
+    s.scanInterval = constrain(prefs.getUShort("interval", s.scanInterval), 1, SCAN_INTERVAL_MAX);
+    s.autoExposure = prefs.getBool("autoExposure", s.autoExposure);
+    s.exposureTarget = constrain(prefs.getFloat("expTarget", s.exposureTarget), EXPOSURE_TARGET_MIN, EXPOSURE_TARGET_MAX);
+    s.hdr = prefs.getBool("hdr", s.hdr);
+    s.continuous = prefs.getBool("continuous", s.continuous);
+    s.gain = min(prefs.getUChar("gain", s.gain), (uint8_t)SENSOR_GAIN_MAX);
+    s.atime = prefs.getUChar("atime", s.atime);
+    s.astep = min(prefs.getUShort("astep", s.astep), (uint16_t)SENSOR_ASTEP_MAX);
+    s.i2cClock[I2C_BUS_SENSOR] = prefs.getUInt("i2cSensor", s.i2cClock[I2C_BUS_SENSOR]);
+    s.i2cClock[I2C_BUS_OLED] = prefs.getUInt("i2cOled", s.i2cClock[I2C_BUS_OLED]);
+    prefs.end();
+  }
+
+  accumulationTime = s.accumulationTime;
+  scanInterval = s.scanInterval;
+  autoExposure = s.autoExposure;
+  exposureTarget = s.exposureTarget;
+  hdrMode = s.hdr;
+  continuousMode = s.continuous;
+  sensorGain = s.gain;
+  sensorAtime = s.atime;
+  sensorAstep = s.astep;
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    i2cInitClock(i, s.i2cClock[i]);
+  }
+
+  // An invalid stored clock was dropped above; compare against what applied
+  storedSettings = currentSettings();
+  pendingSettings = storedSettings;
+}
+
+// Write the keys of s that differ from what NVS holds
+void settingsWrite(const Settings& s) {
+  Preferences prefs;
+  if (!prefs.begin("settings", false)) {
+    return;
+  }
+  const Settings& old = storedSettings;
+  if (s.accumulationTime != old.accumulationTime) prefs.putUShort("accTime", s.accumulationTime);
+  if (s.scanInterval != old.scanInterval) prefs.putUShort("interval", s.scanInterval);
+  if (s.autoExposure != old.autoExposure) prefs.putBool("autoExposure", s.autoExposure);
+  if (s.exposureTarget != old.exposureTarget) prefs.putFloat("expTarget", s.exposureTarget);
+  if (s.hdr != old.hdr) prefs.putBool("hdr", s.hdr);
+  if (s.continuous != old.continuous) prefs.putBool("continuous", s.continuous);
+  if (s.gain != old.gain) prefs.putUChar("gain", s.gain);
+  if (s.atime != old.atime) prefs.putUChar("atime", s.atime);
+  if (s.astep != old.astep) prefs.putUShort("astep", s.astep);
+  if (s.i2cClock[I2C_BUS_SENSOR] != old.i2cClock[I2C_BUS_SENSOR]) prefs.putUInt("i2cSensor", s.i2cClock[I2C_BUS_SENSOR]);
+  if (s.i2cClock[I2C_BUS_OLED] != old.i2cClock[I2C_BUS_OLED]) prefs.putUInt("i2cOled", s.i2cClock[I2C_BUS_OLED]);
+  prefs.end();
+  storedSettings = s;
+}
+
+// Called from loop(): notice changes and store them once they settle
+void serviceSettings() {
+  Settings now = currentSettings();
+  if (!settingsEqual(now, pendingSettings)) {
+    pendingSettings = now;
+    settingsChangedAt = millis();
+  }
+  if (!settingsEqual(pendingSettings, storedSettings) && millis() - settingsChangedAt >= SETTINGS_DEBOUNCE_MS) {
+    settingsWrite(pendingSettings);
+  }
+}
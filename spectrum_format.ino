@@ -0,0 +1,126 @@
+#include "config.h"
+
+// Compact binary encoding of one scan, served by /data?fmt=bin (or
+// Accept: application/octet-stream) and by the WebSocket data command.
+// Little endian throughout:
+//
+//    0  char[2]  magic "TS"
+//    2  u8       version (SPECTRUM_BIN_VERSION)
+//    3  u8       flags: SPECTRUM_BIN_HDR | SPECTRUM_BIN_DARK_CORRECTED
+//    4  u32      scanId
+//    8  u32      startTime (ms since boot)
+//   12  u32      elapsedMs
+//   16  u16      readingCount
+//   18  u16      saturated, bit i set when channel i clipped
+//   20  u8 x2    AGAIN register value of each SMUX group
+//   22  u16      gridCount
+//   24  u32 x2   integration time of each SMUX group (us)
+//   32  f32      gridStart (nm)
+//   36  f32      gridStep (nm)
+//   40  u8       channelCount
+//   41  u8 x3    reserved
+//   44  f16      interpolated intensity x gridCount
+//       u16      channel center wavelength (nm) x channelCount
+//       f16      channel reading (basic counts) x channelCount
+//
+// Basic counts never exceed 1 / (0.5x * 2.78us per step) ~ 720, well inside
+// float16 range, so half precision only costs the last few significant bits.
+#define SPECTRUM_BIN_VERSION 1
+#define SPECTRUM_BIN_HDR 0x01
+#define SPECTRUM_BIN_DARK_CORRECTED 0x02
+
+uint8_t* binPut8(uint8_t* p, uint8_t v) {
+  *p = v;
+  return p + 1;
+}
+
+uint8_t* binPut16(uint8_t* p, uint16_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+uint8_t* binPut32(uint8_t* p, uint32_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+uint8_t* binPutFloat(uint8_t* p, float v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+uint16_t binGet16(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// IEEE 754 binary16, round to nearest; values beyond range clamp to the largest finite half
+uint16_t floatToHalf(float value) {
+  uint32_t f;
+  memcpy(&f, &value, sizeof(f));
+  uint16_t sign = (f >> 16) & 0x8000;
+  uint32_t mantissa = f & 0x7FFFFF;
+  int exponent = (int)((f >> 23) & 0xFF) - 127 + 15;
+
+  if (((f >> 23) & 0xFF) == 0xFF) {
+    return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+  }
+  if (exponent >= 31) {
+    return sign | 0x7BFF;
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1) half++;
+    return sign | half;
+  }
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) half++; // a carry into the exponent is still the right value
+  return sign | min(half, (uint32_t)0x7BFF);
+}
+
+size_t encodeSpectrum(const SpectrumFrame& frame, uint8_t* out) {
+  uint16_t saturated = 0;
+  for (int i = 0; i < 10; i++) {
+    if (frame.saturated[i]) saturated |= 1 << i;
+  }
+  float gridStart = frame.interpolated[0][0];
+  float gridStep = (frame.interpolated[interpolationPoints - 1][0] - gridStart) / (interpolationPoints - 1);
+
+  uint8_t* p = out;
+  p = binPut8(p, 'T');
+  p = binPut8(p, 'S');
+  p = binPut8(p, SPECTRUM_BIN_VERSION);
+  p = binPut8(p, (frame.hdr ? SPECTRUM_BIN_HDR : 0) | (frame.darkCorrected ? SPECTRUM_BIN_DARK_CORRECTED : 0));
+  p = binPut32(p, frame.scanId);
+  p = binPut32(p, frame.startTime);
+  p = binPut32(p, frame.elapsedTime);
+  p = binPut16(p, frame.readingCount);
+  p = binPut16(p, saturated);
+  p = binPut8(p, frame.exposure[0].gain);
+  p = binPut8(p, frame.exposure[1].gain);
+  p = binPut16(p, interpolationPoints);
+  p = binPut32(p, as7341IntegrationTimeUs(frame.exposure[0]));
+  p = binPut32(p, as7341IntegrationTimeUs(frame.exposure[1]));
+  p = binPutFloat(p, gridStart);
+  p = binPutFloat(p, gridStep);
+  p = binPut8(p, 10);
+  p = binPut8(p, 0);
+  p = binPut16(p, 0);
+
+  for (int i = 0; i < interpolationPoints; i++) {
+    p = binPut16(p, floatToHalf(frame.interpolated[i][1]));
+  }
+  for (int i = 0; i < 10; i++) {
+    p = binPut16(p, (uint16_t)channelWavelengths[i]);
+  }
+  for (int i = 0; i < 10; i++) {
+    p = binPut16(p, floatToHalf(frame.readings[i]));
+  }
+  return p - out;
+}
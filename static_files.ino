@@ -0,0 +1,197 @@
+#include "config.h"
+#include <LittleFS.h>
+
+// Web UI files from the LittleFS partition (the sketch's data/ folder, written
+// by tools/build_assets.py). Requests that match no route are looked up here,
+// preferring a precompressed .gz variant when the client accepts gzip.
+#define STATIC_CHUNK 1024
+
+bool staticFsMounted = false;
+
+// Served for /config while the UI files are missing from LittleFS, so a
+// freshly flashed device can still be put on the network
+const char WIFI_FALLBACK_PAGE[] PROGMEM =
+  "<!DOCTYPE html><html><head><meta name=\"viewport\" content=\"width=device-width\">"
+  "<title>Tricorder WiFi Setup</title></head><body><h1>WiFi Setup</h1>"
+  "<p>The web UI is not on the LittleFS partition yet. Upload the data/ folder for the full interface.</p>"
+  "<form method=\"POST\" action=\"/save-wifi\">"
+  "<p><input name=\"ssid\" placeholder=\"SSID\" required></p>"
+  "<p><input name=\"password\" type=\"password\" placeholder=\"Password\"></p>"
+  "<p><button>Save and restart</button></p></form></body></html>";
+
+void staticFilesBegin() {
+  staticFsMounted = LittleFS.begin();
+#ifdef WEB_ASSETS_LITTLEFS
+  if (!staticFsMounted) {
+    Serial.println("LittleFS mount failed; web UI files are unavailable.");
+  } else if (!LittleFS.exists("/index.html.gz") && !LittleFS.exists("/index.html")) {
+    Serial.println("Web UI files missing from LittleFS; upload the data/ folder.");
+  }
+#endif
+}
+
+// The UI files are not on LittleFS: keep the WiFi setup reachable
+void staticFileMissing(const String& path) {
+  if (path == "/config.html") {
+    server.send_P(200, "text/html", WIFI_FALLBACK_PAGE);
+  } else if (path == "/index.html") {
+    server.send(503, "text/html",
+                "Web UI files missing. Upload the data/ folder to the LittleFS partition, "
+                "or set up WiFi at <a href=\"/config\">/config</a>.");
+  } else {
+    server.send(404, "text/plain", "Not found");
+  }
+}
+
+const char* staticContentType(const String& path) {
+  if (path.endsWith(".html")) return "text/html";
+  if (path.endsWith(".js")) return "application/javascript";
+  if (path.endsWith(".css")) return "text/css";
+  if (path.endsWith(".json")) return "application/json";
+  if (path.endsWith(".svg")) return "image/svg+xml";
+  if (path.endsWith(".png")) return "image/png";
+  if (path.endsWith(".ico")) return "image/x-icon";
+  return "application/octet-stream";
+}
+
+// "/" -> /index.html, "/config" -> /config.html
+String staticFsPath(const String& uri) {
+  if (uri.endsWith("/")) {
+    return uri + "index.html";
+  }
+  int slash = uri.lastIndexOf('/');
+  if (uri.indexOf('.', slash) < 0) {
+    return uri + ".html";
+  }
+  return uri;
+}
+
+// build_assets.py names scripts and styles name.<8 hex digits>.ext
+bool staticImmutable(const String& path) {
+  int end = path.lastIndexOf('.');
+  int start = end - 9;
+  if (start < 0 || path[start] != '.') {
+    return false;
+  }
+  for (int i = start + 1; i < end; i++) {
+    if (!isxdigit(path[i])) return false;
+  }
+  return true;
+}
+
+// Single range "bytes=a-b", "bytes=a-" or "bytes=-n". Returns false if it
+// cannot be satisfied; multiple ranges are not supported.
+bool parseRange(const String& header, size_t size, size_t& start, size_t& end) {
+  if (!header.startsWith("bytes=") || header.indexOf(',') >= 0 || size == 0) {
+    return false;
+  }
+  int dash = header.indexOf('-');
+  if (dash < 0) {
+    return false;
+  }
+  String first = header.substring(6, dash);
+  String last = header.substring(dash + 1);
+  if (first.length() == 0 && last.length() == 0) {
+    return false;
+  }
+  if (first.length() == 0) {
+    size_t suffix = strtoul(last.c_str(), NULL, 10);
+    if (suffix == 0) return false;
+    start = suffix >= size ? 0 : size - suffix;
+    end = size - 1;
+    return true;
+  }
+  start = strtoul(first.c_str(), NULL, 10);
+  end = last.length() > 0 ? strtoul(last.c_str(), NULL, 10) : size - 1;
+  if (end >= size) end = size - 1;
+  return start <= end;
+}
+
+void handleStaticFile() {
+  HTTPMethod method = server.method();
+  if (method != HTTP_GET && method != HTTP_HEAD) {
+    server.send(404, "text/plain", "Not found");
+    return;
+  }
+  String path = staticFsPath(server.uri());
+  String stored = path + ".gz";
+  bool gzip = staticFsMounted && server.header("Accept-Encoding").indexOf("gzip") >= 0 && LittleFS.exists(stored);
+  if (!gzip) {
+    stored = path;
+    if (!staticFsMounted || !LittleFS.exists(stored)) {
+      staticFileMissing(path);
+      return;
+    }
+  }
+  File file = LittleFS.open(stored, "r");
+  if (!file || file.isDirectory()) {
+    server.send(404, "text/plain", "Not found");
+    return;
+  }
+
+  size_t size = file.size();
+  time_t modified = file.getLastWrite();
+  char etag[40];
+  snprintf(etag, sizeof(etag), "\"%lx-%lx%s\"", (unsigned long)size, (unsigned long)modified, gzip ? "g" : "");
+  char lastModified[32] = "";
+  if (modified > 0) {
+    struct tm tm;
+    gmtime_r(&modified, &tm);
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    server.sendHeader("Last-Modified", lastModified);
+  }
+  server.sendHeader("Accept-Ranges", "bytes");
+  server.sendHeader("Vary", "Accept-Encoding");
+  if (gzip) {
+    server.sendHeader("Content-Encoding", "gzip");
+  }
+  const char* cacheControl = staticImmutable(path) ? "public, max-age=31536000, immutable" : "no-cache";
+  // Clients echo Last-Modified back verbatim, so a string compare is enough
+  bool unchanged = !server.hasHeader("If-None-Match") && lastModified[0] &&
+                   server.header("If-Modified-Since") == lastModified;
+  if (notModified(etag, cacheControl)) {
+    file.close();
+    return;
+  }
+  if (unchanged) {
+    server.send(304);
+    file.close();
+    return;
+  }
+
+  size_t start = 0;
+  size_t end = size - 1;
+  int code = 200;
+  if (server.hasHeader("Range")) {
+    if (!parseRange(server.header("Range"), size, start, end)) {
+      char contentRange[32];
+      snprintf(contentRange, sizeof(contentRange), "bytes */%lu", (unsigned long)size);
+      server.sendHeader("Content-Range", contentRange);
+      server.send(416, "text/plain", "");
+      file.close();
+      return;
+    }
+    char contentRange[48];
+    snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu",
+             (unsigned long)start, (unsigned long)end, (unsigned long)size);
+    server.sendHeader("Content-Range", contentRange);
+    code = 206;
+  }
+
+  size_t remaining = size > 0 ? end - start + 1 : 0;
+  server.setContentLength(remaining);
+  server.send(code, staticContentType(path), "");
+  if (method == HTTP_HEAD) {
+    file.close();
+    return;
+  }
+  static uint8_t chunk[STATIC_CHUNK];
+  file.seek(start);
+  while (remaining > 0) {
+    size_t n = file.read(chunk, min(remaining, (size_t)STATIC_CHUNK));
+    if (n == 0) break;
+    server.sendContent((const char*)chunk, n);
+    remaining -= n;
+  }
+  file.close();
+}
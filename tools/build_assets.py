@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""Build the web UI from the sources in web/.
+
+Every file is minified and gzipped. Scripts and stylesheets get
+content-hashed URLs (app.js -> /app.1a2b3c4d.js) which the pages are
+rewritten to reference, so the device can serve them as immutable. Pages keep
+stable URLs (index.html -> /, config.html -> /config) and are revalidated.
+
+By default the gzipped files are written to data/, to be uploaded to the
+LittleFS partition, and web_assets.h only tells the firmware to serve them
+from there. With --embed they are compiled into the firmware as PROGMEM
+arrays in web_assets.h instead.
+
+Run after editing anything in web/:
+
+    python3 tools/build_assets.py
+
+With --check it only reports whether the output is up to date. With
+--echarts the main page also loads the echarts bundle from echarts_min_js.h
+(about 177 KB gzipped) instead of the built-in plotter.
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SOURCE_DIR = os.path.join(ROOT, "web")
+OUTPUT = os.path.join(ROOT, "web_assets.h")
+DATA_DIR = os.path.join(ROOT, "data")
+ECHARTS_HEADER = os.path.join(ROOT, "echarts_min_js.h")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+}
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};:,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_lines(text, comment):
+    # Line based on purpose: keeping the newlines keeps JavaScript's automatic
+    # semicolon insertion intact without having to parse anything.
+    out = []
+    for line in text.split("\n"):
+        line = line.strip()
+        if line and not line.startswith(comment):
+            out.append(line)
+    return "\n".join(out)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return minify_lines(text, "//")
+
+
+def minify(name, text):
+    ext = os.path.splitext(name)[1]
+    if ext == ".css":
+        return minify_css(text)
+    if ext == ".js":
+        return minify_lines(text, "//")
+    return minify_html(text)
+
+
+def short_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def symbol(name):
+    return "ASSET_" + re.sub(r"[^A-Za-z0-9]", "_", name).upper()
+
+
+def load_assets(echarts=False):
+    names = sorted(n for n in os.listdir(SOURCE_DIR) if os.path.splitext(n)[1] in CONTENT_TYPES)
+    pages = [n for n in names if n.endswith(".html")]
+    assets = []
+    urls = {}
+
+    # Scripts and stylesheets first, so pages can be rewritten to their hashed URLs
+    for name in names:
+        if name in pages:
+            continue
+        with open(os.path.join(SOURCE_DIR, name), encoding="utf-8") as f:
+            body = minify(name, f.read()).encode("utf-8")
+        digest = short_hash(body)
+        stem, ext = os.path.splitext(name)
+        urls[name] = "/%s.%s%s" % (stem, digest, ext)
+        assets.append((name, urls[name], body, digest, True))
+
+    def rewrite(match):
+        return '%s="%s"' % (match.group(1), urls.get(match.group(2), match.group(2)))
+
+    for name in pages:
+        with open(os.path.join(SOURCE_DIR, name), encoding="utf-8") as f:
+            text = minify(name, f.read())
+        text = re.sub(r'\b(src|href)="([^"]+)"', rewrite, text)
+        if echarts and name == "index.html":
+            text = text.replace("</head>", '<script src="/echarts.min.js"></script>\n</head>', 1)
+        body = text.encode("utf-8")
+        path = "/" if name == "index.html" else "/" + os.path.splitext(name)[0]
+        assets.append((name, path, body, short_hash(body), False))
+    return assets
+
+
+def fs_name(path, immutable):
+    if path == "/":
+        return "index.html.gz"
+    return path.lstrip("/") + ("" if immutable else ".html") + ".gz"
+
+
+def echarts_gz():
+    with open(ECHARTS_HEADER, encoding="utf-8") as f:
+        text = f.read()
+    body = text[text.index("{") + 1:text.index("};")]
+    return bytes(int(b, 16) for b in re.findall(r"0x([0-9a-fA-F]{2})", body))
+
+
+def render_fs(assets, echarts=False):
+    files = {}
+    for name, path, body, digest, immutable in assets:
+        files[fs_name(path, immutable)] = gzip.compress(body, compresslevel=9, mtime=0)
+    if echarts:
+        files["echarts.min.js.gz"] = echarts_gz()
+    header = "\n".join([
+        "// Generated by tools/build_assets.py from the files in web/. Do not edit.",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "",
+        "// The web UI is served from LittleFS; upload the data/ folder.",
+        "#define WEB_ASSETS_LITTLEFS",
+        "",
+        "#endif",
+    ]) + "\n"
+    return header, files
+
+
+def render(assets, echarts=False):
+    out = [
+        "// Generated by tools/build_assets.py --embed from the files in web/. Do not edit.",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "",
+    ]
+    if echarts:
+        out += ["#define USE_ECHARTS", ""]
+    table = []
+    for name, path, body, digest, immutable in assets:
+        data = gzip.compress(body, compresslevel=9, mtime=0)
+        out.append("// %s: %d bytes, %d gzipped" % (name, len(body), len(data)))
+        out.append("const uint8_t %s[] PROGMEM = {" % symbol(name))
+        for i in range(0, len(data), 16):
+            out.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+        ctype = CONTENT_TYPES[os.path.splitext(name)[1]]
+        table.append('  {"%s", "%s", %s, %d, "\\"%s\\"", %s},'
+                     % (path, ctype, symbol(name), len(data), digest, "true" if immutable else "false"))
+    out.append("const WebAsset WEB_ASSETS[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);")
+    out.append("")
+    out.append("#endif")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--check", action="store_true", help="fail if the output is stale")
+    parser.add_argument("--embed", action="store_true", help="compile the assets into the firmware")
+    parser.add_argument("--echarts", action="store_true", help="plot with the echarts bundle")
+    args = parser.parse_args()
+
+    assets = load_assets(args.echarts)
+    if args.embed:
+        generated, files = render(assets, args.echarts), {}
+    else:
+        generated, files = render_fs(assets, args.echarts)
+
+    current = None
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            current = f.read()
+    existing = {}
+    if os.path.isdir(DATA_DIR):
+        for name in os.listdir(DATA_DIR):
+            with open(os.path.join(DATA_DIR, name), "rb") as f:
+                existing[name] = f.read()
+
+    if args.check:
+        if current != generated or existing != files:
+            print("web_assets.h or data/ is out of date; run tools/build_assets.py", file=sys.stderr)
+            return 1
+        return 0
+    if current != generated:
+        with open(OUTPUT, "w", encoding="utf-8") as f:
+            f.write(generated)
+        print("Wrote %s" % os.path.relpath(OUTPUT, ROOT))
+    # data/ holds nothing but generated files, so stale hashed names are removed
+    for name in existing:
+        if name not in files:
+            os.remove(os.path.join(DATA_DIR, name))
+            print("Removed data/%s" % name)
+    for name, data in files.items():
+        if existing.get(name) != data:
+            os.makedirs(DATA_DIR, exist_ok=True)
+            with open(os.path.join(DATA_DIR, name), "wb") as f:
+                f.write(data)
+            print("Wrote data/%s" % name)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
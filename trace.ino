@@ -0,0 +1,120 @@
+#include "config.h"
+#include <esp_timer.h>
+
+// Timeline of the acquisition pipeline, served at /trace in the Chrome
+// trace-event format (load it in chrome://tracing or ui.perfetto.dev). Short
+// spans are timed with the cycle counter of the core they ran on (loop() and
+// the sensor task are pinned to different ones) and placed on the esp_timer
+// clock, which both cores share. The ring keeps the most recent TRACE_SPANS.
+#define TRACE_SPANS 512
+#define TRACE_CHUNK 2048
+
+// Thread ids in the trace
+#define TRACE_TID_LOOP 1
+#define TRACE_TID_SENSOR 2
+
+struct TraceSpan {
+  const char* name;
+  const char* category;
+  uint64_t startUs;
+  float durationUs;
+  uint32_t scanId;
+  uint8_t tid;
+};
+
+TraceSpan traceSpans[TRACE_SPANS];
+uint32_t traceNext = 0; // total spans recorded; the ring index is this mod TRACE_SPANS
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+void traceSpan(const char* name, const char* category, uint64_t startUs, float durationUs) {
+  uint8_t tid = xTaskGetCurrentTaskHandle() == sensorTaskHandle ? TRACE_TID_SENSOR : TRACE_TID_LOOP;
+  portENTER_CRITICAL(&traceMux);
+  TraceSpan& span = traceSpans[traceNext % TRACE_SPANS];
+  span.name = name;
+  span.category = category;
+  span.startUs = startUs;
+  span.durationUs = durationUs;
+  span.scanId = currentScanId;
+  span.tid = tid;
+  traceNext++;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+uint64_t traceClockUs() {
+  return esp_timer_get_time();
+}
+
+// Start a span; pass the result to traceEnd() on the same task. Spans must
+// be shorter than one cycle counter wrap (about 17 s at 240 MHz); time longer
+// ones with traceClockUs() and traceSpan().
+uint32_t traceBegin() {
+  return ESP.getCycleCount();
+}
+
+// Record the span and return its duration in microseconds
+float traceEnd(uint32_t begin, const char* name, const char* category) {
+  uint32_t cycles = ESP.getCycleCount() - begin;
+  float durationUs = (float)cycles / getCpuFrequencyMhz();
+  traceSpan(name, category, esp_timer_get_time() - (uint64_t)durationUs, durationUs);
+  return durationUs;
+}
+
+void traceThreadName(JsonWriter& w, int tid, const char* name) {
+  jsonRaw(w, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+  jsonUInt(w, tid);
+  jsonRaw(w, ",\"args\":{\"name\":");
+  jsonString(w, name);
+  jsonRaw(w, "}}");
+}
+
+// /trace returns every span in the ring, /trace?scan=<id> only those
+// recorded while scan <id> was the current one
+void handleTrace() {
+  uint32_t scan = server.hasArg("scan") ? strtoul(server.arg("scan").c_str(), NULL, 10) : 0;
+  static char buf[TRACE_CHUNK];
+  JsonWriter w;
+  jsonBegin(w, buf, sizeof(buf));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+
+  jsonRaw(w, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  traceThreadName(w, TRACE_TID_LOOP, "loop");
+  jsonRaw(w, ",\n");
+  traceThreadName(w, TRACE_TID_SENSOR, "sensor");
+
+  portENTER_CRITICAL(&traceMux);
+  uint32_t end = traceNext;
+  portEXIT_CRITICAL(&traceMux);
+  uint32_t first = end > TRACE_SPANS ? end - TRACE_SPANS : 0;
+  for (uint32_t i = first; i < end; i++) {
+    TraceSpan span;
+    portENTER_CRITICAL(&traceMux);
+    bool overwritten = traceNext - i > TRACE_SPANS;
+    span = traceSpans[i % TRACE_SPANS];
+    portEXIT_CRITICAL(&traceMux);
+    if (overwritten || (scan != 0 && span.scanId != scan)) {
+      continue;
+    }
+    char ts[24];
+    jsonRaw(w, ",\n{\"name\":");
+    jsonString(w, span.name);
+    jsonRaw(w, ",\"cat\":");
+    jsonString(w, span.category);
+    jsonRaw(w, ",\"ph\":\"X\",\"pid\":1,\"tid\":");
+    jsonUInt(w, span.tid);
+    jsonRaw(w, ",\"ts\":");
+    jsonWrite(w, ts, snprintf(ts, sizeof(ts), "%llu", (unsigned long long)span.startUs));
+    jsonRaw(w, ",\"dur\":");
+    jsonFixed(w, span.durationUs, 3);
+    jsonRaw(w, ",\"args\":{\"scan\":");
+    jsonUInt(w, span.scanId);
+    jsonRaw(w, "}}");
+    if (w.len > TRACE_CHUNK - 256) {
+      server.sendContent(w.buf, w.len);
+      jsonBegin(w, buf, sizeof(buf));
+    }
+  }
+  jsonRaw(w, "\n]}\n");
+  server.sendContent(w.buf, w.len);
+  server.sendContent("");
+}
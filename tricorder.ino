@@ -2,7 +2,6 @@
 #include <Wire.h>
 #include "DFRobot_AS7341.h"
 #include <ArduinoJson.h>
-#include "echarts_min_js.h"
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 
@@ -17,14 +16,30 @@
 #define DISPLAY_OFFSET_Y 15
 #define USABLE_WIDTH 72
 #define USABLE_HEIGHT 40
+#define DISPLAY_REFRESH_MS 250
+
+// The OLED has the second I2C controller to itself, so redraws never touch
+// the sensor bus. The library switches Wire1 to the clock fixed at
+// construction around its own transfers (begin and the boot screens), which
+// runs before the stored settings are loaded; setClock() replaces it with the
+// configured OLED clock.
+class OledDisplay : public Adafruit_SSD1306 {
+public:
+  using Adafruit_SSD1306::Adafruit_SSD1306;
+  void setClock(uint32_t hz) {
+    wireClk = hz;
+    restoreClk = hz;
+  }
+};
 
-// Create display object
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+OledDisplay display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire1, OLED_RESET, I2C_CLOCK_FAST, I2C_CLOCK_FAST);
 
 // Scan timing
 unsigned long scanStartTime = 0;
 unsigned long scanElapsedTime = 0;
 unsigned long lastDisplayUpdate = 0;
+bool displayDirty = false;
+SemaphoreHandle_t i2cMutex = NULL;
 
 // Global object definitions
 WebServer server(80);
@@ -36,10 +51,17 @@ String ssid = "";
 String password = "";
 bool apMode = false;
 
-// Data collection variables
-bool collecting = false;
+// Data collection variables; the tunables are defaults that settings.ino
+// replaces with the stored values at boot
+volatile bool collecting = false;
 unsigned int accumulationTime = 1; // seconds
 unsigned int scanInterval = 2; // seconds
+uint8_t sensorGain = 10; // 512x; the driver clamped the old setAGAIN(128) to this
+uint8_t sensorAtime = 100;
+uint16_t sensorAstep = 999;
+bool autoExposure = true;
+float exposureTarget = 0.5f; // fraction of full scale
+bool hdrMode = false;
 const int interpolationPoints = 100;
 
 // AS7341 channel center wavelengths (nm)
@@ -52,13 +74,10 @@ const char* channelNames[10] = {
   "NIR (910nm)", "Clear"
 };
 
-// Store raw and normalized readings
+// Working buffers of the sensor task; other tasks read published SpectrumFrames
 float normalizedReadings[10] = {0};
 float interpolatedSpectrum[interpolationPoints][2];
 
-DFRobot_AS7341::sModeOneData_t data1;
-DFRobot_AS7341::sModeTwoData_t data2;
-
 // Display helper function - prints text at offset coordinates
 void displayPrint(int x, int y, const char* text) {
   display.setCursor(DISPLAY_OFFSET_X + x, DISPLAY_OFFSET_Y + y);
@@ -70,45 +89,53 @@ void displayPrintln(int x, int y, const char* text) {
   display.println(text);
 }
 
-// Update OLED display with current status
+// Update OLED display with current status. Only what changed is redrawn
+// and sent (see display.ino). Window layout: two text lines, a bar per
+// visible channel on rows 17-32 (exactly pages 4 and 5), and the progress
+// of the running scan below.
 void updateDisplay() {
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setTextColor(SSD1306_WHITE);
+  displayBegin();
   
-  // Line 1: WiFi Status
-  displayPrint(0, 0, apMode ? "AP Mode" : "WiFi OK");
-  
-  // Line 2: IP or status
-  if (!apMode && WiFi.status() == WL_CONNECTED) {
-    displayPrint(0, 10, WiFi.localIP().toString().c_str());
-  } else if (apMode) {
-    displayPrint(0, 10, "192.168.4.1");
-  }
-  
-  // Line 3: Collection status
-  if (collecting) {
-    displayPrint(0, 20, "SCANNING");
+  // Line 1: network; the AP address is always 192.168.4.1
+  if (apMode) {
+    displayField(0, 0, "AP Mode");
+  } else if (WiFi.status() == WL_CONNECTED) {
+    displayField(0, 0, WiFi.localIP().toString().c_str());
   } else {
-    displayPrint(0, 20, "Ready");
+    displayField(0, 0, "No WiFi");
   }
   
-  // Line 4: Show peak channel
-  if (normalizedReadings[0] > 0) {
+  // Line 2: Collection status and peak channel
+  static SpectrumFrame frame;
+  readLatestSpectrum(frame);
+  char buf[16];
+  const char* state = collecting ? "Scan" : "Ready";
+  if (frame.readings[0] > 0) {
     float maxVal = 0;
     int maxIdx = 0;
     for (int i = 0; i < 8; i++) { // Only visible channels
-      if (normalizedReadings[i] > maxVal) {
-        maxVal = normalizedReadings[i];
+      if (frame.readings[i] > maxVal) {
+        maxVal = frame.readings[i];
         maxIdx = i;
       }
     }
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%.0fnm", channelWavelengths[maxIdx]);
-    displayPrint(0, 30, buf);
+    snprintf(buf, sizeof(buf), "%s %.0fnm", state, channelWavelengths[maxIdx]);
+  } else {
+    snprintf(buf, sizeof(buf), "%s", state);
   }
+  displayField(1, 8, buf);
   
-  display.display();
+  // F1-F8 of the latest scan, then the scan progress
+  displayBars(17, 16, frame.readings);
+  displayProgress(34, 4, collecting ? acquisitionProgress() : 0.0f);
+  
+  displayFlush();
+}
+
+void refreshDisplay() {
+  uint32_t span = traceBegin();
+  updateDisplay();
+  metricsObserve(displayLatency, traceEnd(span, "display", "display"));
 }
 
 // Cubic interpolation for smoother curves (Catmull-Rom spline)
@@ -122,55 +149,6 @@ float cubicInterpolate(float p0, float p1, float p2, float p3, float t) {
   return a0*t3 + a1*t2 + a2*t + a3;
 }
 
-// Read and accumulate sensor data
-void readAndAccumulate() {
-  long accumulatedReadings[10] = {0};
-  int readingCount = 0;
-  unsigned long startTime = millis();
-
-  Serial.println("Starting accumulation...");
-  
-  // Update display to show scanning
-  collecting = true;
-  updateDisplay();
-
-  while (millis() - startTime < accumulationTime * 1000) {
-    as7341.startMeasure(as7341.eF1F4ClearNIR);
-    data1 = as7341.readSpectralDataOne();
-    
-    as7341.startMeasure(as7341.eF5F8ClearNIR);
-    data2 = as7341.readSpectralDataTwo();
-
-    accumulatedReadings[0] += data1.ADF1;
-    accumulatedReadings[1] += data1.ADF2;
-    accumulatedReadings[2] += data1.ADF3;
-    accumulatedReadings[3] += data1.ADF4;
-    accumulatedReadings[4] += data2.ADF5;
-    accumulatedReadings[5] += data2.ADF6;
-    accumulatedReadings[6] += data2.ADF7;
-    accumulatedReadings[7] += data2.ADF8;
-    accumulatedReadings[8] += data1.ADNIR;
-    accumulatedReadings[9] += data1.ADCLEAR;
-    
-    readingCount++;
-    delay(50);
-  }
-
-  Serial.print("Accumulated ");
-  Serial.print(readingCount);
-  Serial.println(" readings.");
-
-  // Average the readings from all 10 channels
-  float avgReadings[10];
-  for (int i = 0; i < 10; i++) {
-    avgReadings[i] = (readingCount > 0) ? (float)accumulatedReadings[i] / readingCount : 0;
-    normalizedReadings[i] = avgReadings[i];
-  }
-  
-  collecting = false;
-  updateDisplay();
-}
-
 // Get interpolated value at a specific wavelength
 float getInterpolatedValue(float wavelength) {
     const float visWavelengths[] = {415, 445, 480, 515, 555, 590, 630, 680};
@@ -228,25 +206,37 @@ void generateInterpolatedSpectrum() {
 }
 
 void handleStatus() {
-  StaticJsonDocument<200> doc;
+  StaticJsonDocument<384> doc;
+  doc["state"] = acquisitionStateName();
+  doc["scanId"] = currentScanId;
+  doc["completedScanId"] = completedScanId;
+  doc["progress"] = acquisitionProgress();
+  doc["continuous"] = continuousMode;
   doc["startTime"] = scanStartTime;
-  doc["elapsedTime"] = scanElapsedTime;
+  doc["elapsedTime"] = collecting ? millis() - scanStartTime : scanElapsedTime;
   doc["heap"] = ESP.getFreeHeap();
+  static SpectrumFrame frame;
+  readLatestSpectrum(frame);
+  doc["samples"] = frame.readingCount;
+  doc["samplesPerSecond"] = frame.elapsedTime > 0 ? frame.readingCount * 1000.0f / frame.elapsedTime : 0;
+  doc["dutyCycle"] = frame.dutyCycle;
   String json;
   serializeJson(doc, json);
   server.send(200, "application/json", json);
 }
 
+void setLight(bool on) {
+  xSemaphoreTake(i2cMutex, portMAX_DELAY);
+  as7341.enableLed(on);
+  xSemaphoreGive(i2cMutex);
+}
+
 void handleLight() {
   if (server.hasArg("state")) {
     String state = server.arg("state");
-    if (state == "on") {
-      as7341.enableLed(true);
-      server.send(200, "text/plain", "Light ON");
-    } else {
-      as7341.enableLed(false);
-      server.send(200, "text/plain", "Light OFF");
-    }
+    bool on = (state == "on");
+    setLight(on);
+    server.send(200, "text/plain", on ? "Light ON" : "Light OFF");
   } else {
     server.send(400, "text/plain", "Missing state parameter");
   }
@@ -255,10 +245,12 @@ void handleLight() {
 void setup() {
   Serial.begin(115200);
   delay(1000);
+  settingsBegin();
 
   // --- OLED Display Initialization (First!) ---
   Serial.println("Initializing OLED Display...");
-  Wire.begin(OLED_SDA, OLED_SCL);
+  Wire1.begin(OLED_SDA, OLED_SCL, i2cClock(I2C_BUS_OLED));
+  display.setClock(i2cClock(I2C_BUS_OLED));
   if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println("OLED init failed!");
   } else {
@@ -274,31 +266,28 @@ void setup() {
 
   // --- I2C and Sensor Initialization ---
   Serial.println("Initializing Sensor...");
-  // Reinitialize Wire for sensor on different pins
-  Wire.end();
-  Wire.begin(SDA_PIN, SCL_PIN);
+  Wire.begin(SDA_PIN, SCL_PIN, i2cClock(I2C_BUS_SENSOR));
   
   while (as7341.begin() != 0) {
     Serial.println("Could not find AS7341 sensor! Check wiring.");
     
     // Show error on display
-    Wire.end();
-    Wire.begin(OLED_SDA, OLED_SCL);
     display.clearDisplay();
     displayPrintln(0, 0, "Sensor");
     displayPrintln(0, 10, "Error!");
     display.display();
-    Wire.end();
-    Wire.begin(SDA_PIN, SCL_PIN);
     
     delay(3000);
   }
   
   Serial.println("AS7341 sensor found!");
-  as7341.setAtime(100);
-  as7341.setAGAIN(128);
-  as7341.setAstep(999);
+  as7341.setAtime(sensorAtime);
+  as7341.setAGAIN(sensorGain);
+  as7341.setAstep(sensorAstep);
+  resetExposure();
   as7341.enableSpectralMeasure(true);
+  as7341EnableInterrupt();
+  as7341StopMeasurement(); // idle until the first scan
 
   // --- WiFi Initialization ---
   Serial.println("Initializing WiFi...");
@@ -308,14 +297,10 @@ void setup() {
   preferences.end();
 
   // Update display during WiFi connection
-  Wire.end();
-  Wire.begin(OLED_SDA, OLED_SCL);
   display.clearDisplay();
   displayPrintln(0, 0, "Connect");
   displayPrintln(0, 10, "WiFi...");
   display.display();
-  Wire.end();
-  Wire.begin(SDA_PIN, SCL_PIN);
 
   if (ssid.length() > 0) {
     Serial.println("Attempting to connect to saved WiFi...");
@@ -342,47 +327,55 @@ void setup() {
 
   // --- Server Initialization ---
   Serial.println("Initializing HTTP server...");
-  server.on("/", handleRoot);
+  staticFilesBegin();
+  registerWebAssets();
+  server.onNotFound(timedHandler("static", handleStaticFile));
   
-  server.on("/echarts.min.js", HTTP_GET, [](){
-    server.sendHeader("Content-Encoding", "gzip");
-    server.sendHeader("Cache-Control", "max-age=86400");
-    server.send_P(200, "application/javascript", 
-                  (const char*)ECHARTS_JS_GZ, 
-                  ECHARTS_JS_GZ_LEN);
-  });
-  
-  server.on("/config", handleConfig);
-  server.on("/save-wifi", HTTP_POST, handleSaveWifi);
-  server.on("/start", handleStart);
-  server.on("/data", handleData);
-  server.on("/getconfig", handleGetConfig);
-  server.on("/setconfig", HTTP_POST, handleSetConfig);
-  server.on("/reset-wifi", handleResetWifi);
-  server.on("/status", handleStatus);
-  server.on("/light", handleLight);
+  server.on("/save-wifi", HTTP_POST, timedHandler("/save-wifi", handleSaveWifi));
+  server.on("/start", timedHandler("/start", handleStart));
+  server.on("/dark", timedHandler("/dark", handleDark));
+  server.on("/continuous", timedHandler("/continuous", handleContinuous));
+  server.on("/history", timedHandler("/history", handleHistory));
+  server.on("/data", timedHandler("/data", handleData));
+  server.on("/getconfig", timedHandler("/getconfig", handleGetConfig));
+  server.on("/setconfig", HTTP_POST, timedHandler("/setconfig", handleSetConfig));
+  server.on("/reset-wifi", timedHandler("/reset-wifi", handleResetWifi));
+  server.on("/status", timedHandler("/status", handleStatus));
+  server.on("/events", HTTP_GET, timedHandler("/events", handleEvents));
+  server.on("/light", timedHandler("/light", handleLight));
+  server.on("/metrics", timedHandler("/metrics", handleMetrics));
+  server.on("/trace", timedHandler("/trace", handleTrace));
+  const char* headerKeys[] = {"Accept", "Accept-Encoding", "If-None-Match", "If-Modified-Since", "Range"};
+  server.collectHeaders(headerKeys, 5);
   
   server.begin();
+  webSocketBegin();
   Serial.println("HTTP server started. Tricorder is ready.");
   
-  // Final display update
-  Wire.end();
-  Wire.begin(OLED_SDA, OLED_SCL);
-  updateDisplay();
-  Wire.end();
-  Wire.begin(SDA_PIN, SCL_PIN);
+  // --- Sensor Task ---
+  historyBegin();
+  i2cMutex = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(sensorTask, "sensor", SENSOR_TASK_STACK, NULL,
+                          SENSOR_TASK_PRIORITY, &sensorTaskHandle, SENSOR_TASK_CORE);
+
+  // Final display update, replacing the boot messages
+  displayInvalidate();
+  refreshDisplay();
 }
 
 void loop() {
   server.handleClient();
+  scheduleScans();
+  serviceEvents();
+  serviceWebSocket();
+  serviceSettings();
+  serviceDark();
   
-  // Update display every 2 seconds
-  if (millis() - lastDisplayUpdate > 2000) {
-    Wire.end();
-    Wire.begin(OLED_SDA, OLED_SCL);
-    updateDisplay();
-    Wire.end();
-    Wire.begin(SDA_PIN, SCL_PIN);
+  // Update display periodically, or right away when the scan state changes.
+  // Unchanged lines cost no bus traffic.
+  if (displayDirty || millis() - lastDisplayUpdate > DISPLAY_REFRESH_MS) {
+    refreshDisplay();
     lastDisplayUpdate = millis();
+    displayDirty = false;
   }
 }
\ No newline at end of file
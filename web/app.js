@@ -0,0 +1,567 @@
+let chart = null;
+let initialOption = null;
+let continuousFollowId = null;
+let lastShownScanId = 0;
+let lastCheckedScanId = 0;
+let events = null;
+let eventsConnected = false;
+let statusPollId = null;
+let latestScan = null;
+let scanWaiters = [];
+let scanHistory = [];
+let clientScanStartTime = 0;
+
+function toggleLight() {
+  const checkbox = document.getElementById('light-checkbox');
+  const state = checkbox.checked ? 'on' : 'off';
+  fetch(`/light?state=${state}`);
+}
+
+function updateStatus() {
+  fetch('/status')
+    .then(response => response.json())
+    .then(showStatus);
+}
+
+function showStatus(data) {
+  const startTimeEl = document.getElementById('start-time');
+  const elapsedTimeEl = document.getElementById('elapsed-time');
+  if (clientScanStartTime > 0) {
+    const startTime = new Date(clientScanStartTime).toLocaleTimeString();
+    startTimeEl.textContent = `Start: ${startTime}`;
+    elapsedTimeEl.textContent = `Elapsed: ${data.elapsedTime / 1000}s`;
+  } else {
+    startTimeEl.textContent = '';
+    elapsedTimeEl.textContent = '';
+  }
+}
+
+// Completed scans and progress are pushed over /events; polling is only
+// the fallback for browsers or devices that cannot hold the stream open
+function connectEvents() {
+  if (!window.EventSource) {
+    fallbackToPolling();
+    return;
+  }
+  events = new EventSource('/events');
+  events.onopen = () => {
+    eventsConnected = true;
+    if (statusPollId) { clearInterval(statusPollId); statusPollId = null; }
+  };
+  events.onerror = () => {
+    if (events.readyState === EventSource.CLOSED) fallbackToPolling();
+  };
+  events.addEventListener('status', e => onStatusEvent(JSON.parse(e.data)));
+  events.addEventListener('scan', e => onScanEvent(JSON.parse(e.data)));
+}
+
+function fallbackToPolling() {
+  eventsConnected = false;
+  if (!statusPollId) statusPollId = setInterval(updateStatus, 5000);
+  if (continuousFollowId === true) continuousFollowId = setInterval(followContinuous, 1000);
+  const waiters = scanWaiters;
+  scanWaiters = [];
+  waiters.forEach(w => pollForScan(w.scanId).then(w.resolve, w.reject));
+}
+
+function onStatusEvent(status) {
+  showStatus(status);
+  if (!status.continuous && continuousFollowId) setContinuousMode(false);
+  scanWaiters = scanWaiters.filter(w => {
+    if (status.completedScanId < w.scanId) return true;
+    w.resolve(status);
+    return false;
+  });
+}
+
+function onScanEvent(data) {
+  latestScan = data;
+  if (continuousFollowId && data.scanId > lastShownScanId) showScan(data, true);
+}
+
+const CMF = {
+    wavelengths: [380, 385, 390, 395, 400, 405, 410, 415, 420, 425, 430, 435, 440, 445, 450, 455, 460, 465, 470, 475, 480, 485, 490, 495, 500, 505, 510, 515, 520, 525, 530, 535, 540, 545, 550, 555, 560, 565, 570, 575, 580, 585, 590, 595, 600, 605, 610, 615, 620, 625, 630, 635, 640, 645, 650, 655, 660, 665, 670, 675, 680, 685, 690, 695, 700, 705, 710, 715, 720, 725, 730, 735, 740, 745, 750, 755, 760, 765, 770, 775, 780],
+    x: [0.0014, 0.0022, 0.0042, 0.0076, 0.0143, 0.0232, 0.0435, 0.0776, 0.1344, 0.2148, 0.2839, 0.3285, 0.3483, 0.3457, 0.3233, 0.2940, 0.2650, 0.2280, 0.1954, 0.1581, 0.1116, 0.0655, 0.0320, 0.0082, 0.0049, 0.0116, 0.0298, 0.0633, 0.1096, 0.1655, 0.2257, 0.2904, 0.3597, 0.4334, 0.5121, 0.5945, 0.6784, 0.7621, 0.8425, 0.9163, 0.9786, 1.0263, 1.0567, 1.0622, 1.0456, 1.0026, 0.9384, 0.8544, 0.7514, 0.6424, 0.5419, 0.4479, 0.3608, 0.2835, 0.2187, 0.1649, 0.1212, 0.0874, 0.0636, 0.0468, 0.0329, 0.0227, 0.0158, 0.0114, 0.0081, 0.0058, 0.0041, 0.0029, 0.0021, 0.0015, 0.0010, 0.0007, 0.0005, 0.0003, 0.0002, 0.0002, 0.0001, 0.0001, 0.0001, 0.0000],
+    y: [0.0000, 0.0001, 0.0001, 0.0002, 0.0004, 0.0006, 0.0012, 0.0022, 0.0040, 0.0073, 0.0116, 0.0168, 0.0230, 0.0298, 0.0380, 0.0480, 0.0600, 0.0739, 0.0910, 0.1126, 0.1390, 0.1693, 0.2080, 0.2586, 0.3230, 0.4073, 0.5030, 0.6082, 0.7100, 0.7932, 0.8620, 0.9149, 0.9540, 0.9803, 0.9950, 1.0000, 0.9950, 0.9786, 0.9520, 0.9154, 0.8700, 0.8163, 0.7570, 0.6949, 0.6310, 0.5668, 0.5030, 0.4412, 0.3810, 0.3210, 0.2650, 0.2170, 0.1750, 0.1382, 0.1070, 0.0816, 0.0610, 0.0446, 0.0320, 0.0227, 0.0159, 0.0112, 0.0079, 0.0057, 0.0041, 0.0029, 0.0021, 0.0015, 0.0010, 0.0007, 0.0005, 0.0003, 0.0002, 0.0002, 0.0001, 0.0001, 0.0001, 0.0000, 0.0000],
+    z: [0.0065, 0.0105, 0.0201, 0.0362, 0.0679, 0.1102, 0.2074, 0.3713, 0.6456, 1.0391, 1.3856, 1.6230, 1.7471, 1.7721, 1.7441, 1.6692, 1.5281, 1.3483, 1.1495, 0.9163, 0.6413, 0.4458, 0.2720, 0.1582, 0.0782, 0.0454, 0.0272, 0.0172, 0.0113, 0.0071, 0.0048, 0.0034, 0.0024, 0.0017, 0.0011, 0.0008, 0.0006, 0.0003, 0.0002, 0.0001, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000]
+};
+
+function initChart() {
+  const chartDom = document.getElementById('chart');
+  // echarts is only present in builds generated with --echarts
+  chart = window.echarts ? echarts.init(chartDom, null, { renderer: 'svg' }) : SpectrumPlot.init(chartDom);
+  initialOption = {
+    title: { text: 'Spectrum Analysis', left: 'center' },
+    tooltip: { trigger: 'axis', formatter: params => `Wavelength: ${params[0].value[0].toFixed(1)} nm<br/>Intensity: ${params[0].value[1].toFixed(4)}` },
+    legend: { top: 40, type: 'scroll' },
+    toolbox: {
+      right: 20,
+      feature: {
+        dataZoom: { yAxisIndex: 'none', title: { zoom: 'Area Zoom', back: 'Restore Zoom' } },
+        dataView: { readOnly: false, title: 'View Data', lang: ['Data View', 'Close', 'Refresh'] },
+        saveAsImage: { name: 'tricorder_spectrum', title: 'Save as Image', type: 'svg' }
+      }
+    },
+    xAxis: {
+      type: 'value', name: 'Wavelength (nm)', nameLocation: 'middle', nameGap: 40, min: 300, max: 1000
+    },
+    yAxis: {
+      type: 'value', name: 'Intensity', nameLocation: 'middle', nameGap: 35, min: 0
+    },
+    series: [],
+    grid: { left: 50, right: 50, top: 80, bottom: 70 }
+  };
+  chart.setOption(initialOption);
+}
+
+function clearChart() {
+    scanHistory = [];
+    chart.setOption(initialOption, true);
+    document.getElementById('status-text').textContent = 'Chart cleared. Ready for new scan.';
+}
+
+// Continuous scans are scheduled by the device; the page only follows along
+function toggleContinuousScan() {
+    const enable = !continuousFollowId;
+    fetch(`/continuous?state=${enable ? 'on' : 'off'}`)
+      .then(response => {
+        if (!response.ok) throw new Error('Failed to change continuous mode.');
+        if (enable) clearChart();
+        setContinuousMode(enable);
+        document.getElementById('status-text').textContent = enable
+          ? `Scanning continuously every ${document.getElementById('scanInterval').value}s.`
+          : 'Continuous scan stopped.';
+      })
+      .catch(error => { document.getElementById('status-text').textContent = `Error: ${error.message}`; });
+}
+
+function setContinuousMode(active) {
+    const contBtn = document.getElementById('contBtn');
+    if (active && !continuousFollowId) {
+        contBtn.textContent = '■ Stop';
+        contBtn.classList.remove('success');
+        contBtn.classList.add('danger');
+        // With the event stream open, scans arrive by themselves
+        continuousFollowId = eventsConnected ? true : setInterval(followContinuous, 1000);
+    } else if (!active && continuousFollowId) {
+        clearInterval(continuousFollowId);
+        continuousFollowId = null;
+        contBtn.textContent = '∞';
+        contBtn.classList.remove('danger');
+        contBtn.classList.add('success');
+    }
+}
+
+function followContinuous() {
+  fetch('/status')
+    .then(response => response.json())
+    .then(status => {
+      if (!status.continuous) { setContinuousMode(false); return; }
+      if (status.completedScanId <= lastCheckedScanId) return;
+      lastCheckedScanId = status.completedScanId;
+      return fetchSpectrum()
+        .then(data => { if (data.scanId > lastShownScanId) showScan(data, true); });
+    })
+    .catch(error => console.error('Error:', error));
+}
+
+// Function to convert wavelength to RGB color
+function wavelengthToRGB(wavelength) {
+  let r, g, b;
+  
+  if (wavelength >= 380 && wavelength < 440) {
+    r = -(wavelength - 440) / (440 - 380);
+    g = 0;
+    b = 1;
+  } else if (wavelength >= 440 && wavelength < 490) {
+    r = 0;
+    g = (wavelength - 440) / (490 - 440);
+    b = 1;
+  } else if (wavelength >= 490 && wavelength < 510) {
+    r = 0;
+    g = 1;
+    b = -(wavelength - 510) / (510 - 490);
+  } else if (wavelength >= 510 && wavelength < 580) {
+    r = (wavelength - 510) / (580 - 510);
+    g = 1;
+    b = 0;
+  } else if (wavelength >= 580 && wavelength < 645) {
+    r = 1;
+    g = -(wavelength - 645) / (645 - 580);
+    b = 0;
+  } else if (wavelength >= 645 && wavelength <= 780) {
+    r = 1;
+    g = 0;
+    b = 0;
+  } else {
+    r = 0;
+    g = 0;
+    b = 0;
+  }
+  
+  // Intensity adjustment for edges of visible spectrum
+  let intensity = 1;
+  if (wavelength >= 380 && wavelength < 420) {
+    intensity = 0.3 + 0.7 * (wavelength - 380) / (420 - 380);
+  } else if (wavelength >= 700 && wavelength <= 780) {
+    intensity = 0.3 + 0.7 * (780 - wavelength) / (780 - 700);
+  }
+  
+  r = Math.round(r * intensity * 255);
+  g = Math.round(g * intensity * 255);
+  b = Math.round(b * intensity * 255);
+  
+  return `rgb(${r}, ${g}, ${b})`;
+}
+const CHANNEL_NAMES = ['F1 (415nm)', 'F2 (445nm)', 'F3 (480nm)', 'F4 (515nm)',
+  'F5 (555nm)', 'F6 (590nm)', 'F7 (630nm)', 'F8 (680nm)', 'NIR (910nm)', 'Clear'];
+
+function halfToFloat(h) {
+  const sign = (h & 0x8000) ? -1 : 1;
+  const exponent = (h >> 10) & 0x1f;
+  const mantissa = h & 0x3ff;
+  if (exponent === 0) return sign * mantissa * Math.pow(2, -24);
+  if (exponent === 31) return mantissa ? NaN : sign * Infinity;
+  return sign * (1 + mantissa / 1024) * Math.pow(2, exponent - 15);
+}
+
+// Decode /data?fmt=bin (layout in spectrum_format.ino) into the /data JSON shape
+function decodeSpectrum(buffer) {
+  const view = new DataView(buffer);
+  if (view.getUint8(0) !== 0x54 || view.getUint8(1) !== 0x53 || view.getUint8(2) !== 1) {
+    throw new Error('Unsupported spectrum format.');
+  }
+  const flags = view.getUint8(3);
+  const saturatedMask = view.getUint16(18, true);
+  const gridCount = view.getUint16(22, true);
+  const gridStart = view.getFloat32(32, true);
+  const gridStep = view.getFloat32(36, true);
+  const channelCount = view.getUint8(40);
+
+  let offset = 44;
+  const interpolated = [];
+  for (let i = 0; i < gridCount; i++, offset += 2) {
+    interpolated.push([gridStart + i * gridStep, halfToFloat(view.getUint16(offset, true))]);
+  }
+  const wavelengths = [];
+  for (let i = 0; i < channelCount; i++, offset += 2) wavelengths.push(view.getUint16(offset, true));
+  const channels = [];
+  for (let i = 0; i < channelCount; i++, offset += 2) {
+    channels.push([wavelengths[i], halfToFloat(view.getUint16(offset, true))]);
+  }
+
+  const raw = channels.slice(0, 9); // Clear is not plotted
+  return {
+    scanId: view.getUint32(4, true),
+    interpolated: interpolated,
+    raw: raw,
+    labels: CHANNEL_NAMES.slice(0, raw.length),
+    connector: [interpolated[interpolated.length - 1], raw[8]],
+    exposure: [0, 1].map(g => ({
+      gain: Math.pow(2, view.getUint8(20 + g)) / 2,
+      integrationMs: view.getUint32(24 + 4 * g, true) / 1000
+    })),
+    saturated: raw.map((c, i) => (saturatedMask & (1 << i)) !== 0),
+    hdr: (flags & 1) !== 0,
+    darkCorrected: (flags & 2) !== 0
+  };
+}
+
+function fetchSpectrum() {
+  return fetch('/data?fmt=bin')
+    .then(response => response.arrayBuffer())
+    .then(decodeSpectrum);
+}
+
+// The device scans in the background; resolve once our scan has completed
+function waitForScan(scanId) {
+  if (!eventsConnected) return pollForScan(scanId);
+  return new Promise((resolve, reject) => scanWaiters.push({ scanId, resolve, reject }));
+}
+
+function pollForScan(scanId) {
+  return new Promise((resolve, reject) => {
+    function poll() {
+      fetch('/status')
+        .then(response => response.json())
+        .then(data => {
+          if (data.completedScanId >= scanId) {
+            resolve(data);
+          } else {
+            setTimeout(poll, 250);
+          }
+        })
+        .catch(reject);
+    }
+    poll();
+  });
+}
+
+function startCollection() {
+  const startBtn = document.getElementById('startBtn');
+  const status = document.getElementById('status-text');
+  
+  startBtn.disabled = true;
+  chart.showLoading();
+  status.textContent = 'Acquiring and processing data... please wait.';
+  document.getElementById('start-time').textContent = '';
+  document.getElementById('elapsed-time').textContent = '';
+  clientScanStartTime = Date.now();
+
+  fetch('/start')
+    .then(response => {
+      if (!response.ok) throw new Error('Failed to start collection.');
+      return response.json();
+    })
+    .then(start => waitForScan(start.scanId).then(() => {
+      // The scan event is sent before the status event that completes it
+      if (latestScan && latestScan.scanId >= start.scanId) return latestScan;
+      return fetchSpectrum();
+    }))
+    .then(data => {
+      if (!continuousFollowId || data.scanId > lastShownScanId) showScan(data, !!continuousFollowId);
+    })
+    .catch(error => {
+      console.error('Error:', error);
+      chart.hideLoading();
+      status.textContent = `Error: ${error.message}`;
+    })
+    .finally(() => {
+      startBtn.disabled = false;
+    });
+}
+
+// Plot one /data result; continuous scans stack up, a single scan replaces the chart
+function showScan(data, isContinuous) {
+      const status = document.getElementById('status-text');
+      lastShownScanId = Math.max(lastShownScanId, data.scanId || 0);
+      if (!isContinuous) {
+        scanHistory = []; // Clear history for single scan
+        chart.setOption(initialOption, true);
+      }
+      scanHistory.push({timestamp: new Date(), data: data});
+
+      const interpolatedLine = [...data.interpolated];
+      const nirPoint = data.raw[8];
+      if (nirPoint) {
+        interpolatedLine.push([750, 0]);
+        interpolatedLine.push([850, 0]);
+        interpolatedLine.push(nirPoint);
+        interpolatedLine.push([1000, 0]);
+      }
+
+      updateColorSwatch(interpolatedLine);
+
+      const sigma = 8.5;
+      function generateGaussian(mu, A) {
+          const points = [];
+          if (A <= 0) return points;
+          for (let x = mu - (3*sigma); x <= mu + (3*sigma); x += (6*sigma)/40) {
+              points.push([x, A * Math.exp(-Math.pow(x - mu, 2) / (2 * Math.pow(sigma, 2)))]);
+          }
+          return points;
+      }
+
+// Generate colored raw channels series
+const rawChannelsSeries = data.raw
+.filter((channelData, idx) => idx < 8) // Only visible spectrum channels (skip NIR)
+.map(channelData => {
+const wavelength = channelData[0];
+const color = wavelengthToRGB(wavelength);
+
+return {
+  name: 'Raw Channels',
+  type: 'line',
+  data: generateGaussian(channelData[0], channelData[1]),
+  smooth: true,
+  showSymbol: false,
+  lineStyle: { 
+    width: 2.5, 
+    opacity: 0.7,
+    color: color
+  },
+  areaStyle: { 
+    opacity: 0.15,
+    color: color
+  },
+  tooltip: { show: false }
+};
+});
+
+      const newSeries = {
+        name: new Date().toLocaleTimeString(),
+        type: 'line',
+        data: interpolatedLine,
+        smooth: true,
+        showSymbol: false
+      };
+
+      const existingSeries = isContinuous ? chart.getOption().series.filter(s => s.name !== 'Raw Channels') : [];
+
+      chart.hideLoading();
+      chart.setOption({
+        series: [
+          ...rawChannelsSeries,
+          ...existingSeries,
+          newSeries
+        ]
+      });
+      status.textContent = `Scan complete. Total scans: ${scanHistory.length}`;
+      const clipped = data.labels.filter((label, idx) => data.saturated && data.saturated[idx]);
+      if (clipped.length > 0) {
+        status.textContent += ` (saturated: ${clipped.join(', ')})`;
+      }
+      if (!eventsConnected) updateStatus();
+}
+
+function captureDark() {
+  if (!confirm('Cover the sensor, then press OK to capture a dark reference.')) return;
+  const status = document.getElementById('status-text');
+  status.textContent = 'Capturing dark reference...';
+  fetch('/dark')
+    .then(response => {
+      if (!response.ok) throw new Error('Failed to start dark capture.');
+      return response.json();
+    })
+    .then(start => waitForScan(start.scanId))
+    .then(() => { status.textContent = 'Dark reference captured.'; })
+    .catch(error => { status.textContent = `Error: ${error.message}`; });
+}
+
+function updateColorSwatch(spectrum) {
+    function getSpectrumValue(wavelength) {
+        if (!spectrum || spectrum.length < 2) return 0;
+        for (let i = 0; i < spectrum.length - 1; i++) {
+            if (wavelength >= spectrum[i][0] && wavelength <= spectrum[i+1][0]) {
+                const w1 = spectrum[i][0], v1 = spectrum[i][1];
+                const w2 = spectrum[i+1][0], v2 = spectrum[i+1][1];
+                if (w2 - w1 === 0) return v1;
+                return v1 + (v2 - v1) * (wavelength - w1) / (w2 - w1);
+            }
+        }
+        return 0;
+    }
+
+    let X = 0, Y = 0, Z = 0;
+     for (let i = 0; i < CMF.wavelengths.length; i++) {
+        const lambda = CMF.wavelengths[i];
+        const val = getSpectrumValue(lambda);
+
+        if (!isFinite(val)) {
+            console.warn(`Skipping invalid spectrum value at ${lambda} nm`);
+            continue; // skip bad points instead of returning
+        }
+
+        const x = CMF.x[i], y = CMF.y[i], z = CMF.z[i];
+        if (!isFinite(x) || !isFinite(y) || !isFinite(z)) {
+            console.warn(`Skipping invalid CMF data at ${lambda} nm`);
+            continue;
+        }
+
+        X += val * x;
+        Y += val * y;
+        Z += val * z;
+    }
+
+    if (Y === 0 || isNaN(X) || isNaN(Y) || isNaN(Z)) {
+        document.getElementById('color-swatch').style.backgroundColor = 'rgb(0,0,0)';
+        return;
+    }
+
+    let Rl =  3.2406 * X - 1.5372 * Y - 0.4986 * Z;
+    let Gl = -0.9689 * X + 1.8758 * Y + 0.0415 * Z;
+    let Bl =  0.0557 * X - 0.2040 * Y + 1.0570 * Z;
+
+    const max = Math.max(Rl, Gl, Bl);
+    if (max > 0) {
+        Rl /= max; Gl /= max; Bl /= max;
+    }
+
+    Rl = Math.max(0, Rl); Gl = Math.max(0, Gl); Bl = Math.max(0, Bl);
+
+    const gamma = c => (c <= 0.0031308) ? 12.92 * c : 1.055 * Math.pow(c, 1/2.4) - 0.055;
+    
+    let r = Math.round(gamma(Rl) * 255);
+    let g = Math.round(gamma(Gl) * 255);
+    let b = Math.round(gamma(Bl) * 255);
+
+    if (isNaN(r) || isNaN(g) || isNaN(b)) return;
+
+    document.getElementById('color-swatch').style.backgroundColor = `rgb(${r},${g},${b})`;
+}
+
+function saveData() {
+  if (scanHistory.length === 0) {
+    alert('No data to save. Please perform a scan first.');
+    return;
+  }
+
+  let fileContent = '# Tricorder Spectrum Data\n';
+  scanHistory.forEach((scan, index) => {
+    fileContent += `\n# --- Scan ${index + 1} at ${scan.timestamp.toISOString()} ---\n`;
+    fileContent += '# Raw Sensor Channels\n';
+    fileContent += '# Wavelength (nm),Normalized Intensity\n';
+    scan.data.raw.forEach(row => { fileContent += row.join(',') + '\n'; });
+    fileContent += '\n# Interpolated Spectrum\n';
+    fileContent += '# Wavelength (nm),Normalized Intensity\n';
+    scan.data.interpolated.forEach(row => { fileContent += row.join(',') + '\n'; });
+  });
+
+  const blob = new Blob([fileContent], { type: 'text/plain;charset=utf-8,' });
+  const link = document.createElement('a');
+  link.href = URL.createObjectURL(blob);
+  const timestamp = new Date().toISOString().replace(/[:.-]/g, '');
+  link.download = `tricorder_multiscan_${timestamp}.txt`;
+  document.body.appendChild(link);
+  link.click();
+  document.body.removeChild(link);
+  URL.revokeObjectURL(link.href);
+}
+
+function loadConfig() {
+  fetch('/getconfig')
+    .then(response => response.json())
+    .then(data => {
+      document.getElementById('accumTime').value = data.accumulationTime;
+      document.getElementById('scanInterval').value = data.scanInterval;
+      document.getElementById('autoExposure').checked = data.autoExposure;
+      document.getElementById('hdr').checked = data.hdr;
+      document.getElementById('ssid').textContent = data.ssid;
+      setContinuousMode(data.continuous);
+    });
+}
+
+function saveConfig() {
+  const time = document.getElementById('accumTime').value;
+  const interval = document.getElementById('scanInterval').value;
+  const status = document.getElementById('status-text');
+  
+  const formData = new FormData();
+  formData.append('accumulationTime', time);
+  formData.append('scanInterval', interval);
+  formData.append('autoExposure', document.getElementById('autoExposure').checked ? '1' : '0');
+  formData.append('hdr', document.getElementById('hdr').checked ? '1' : '0');
+
+  fetch('/setconfig', { method: 'POST', body: new URLSearchParams(formData) })
+    .then(response => {
+        if(response.ok) {
+            status.textContent = `Configuration saved.`;
+        } else {
+            status.textContent = 'Error saving configuration.';
+        }
+    });
+}
+
+function resetWifi() {
+  if (confirm('This will reset WiFi settings and restart the device. Are you sure?')) {
+    fetch('/reset-wifi').then(() => alert('Device is restarting in AP mode.'));
+  }
+}
+
+window.onload = function() {
+  initChart();
+  loadConfig();
+  connectEvents();
+};
+
+window.onresize = () => chart && chart.resize();
@@ -0,0 +1,410 @@
+// Small canvas plotter for the spectrum chart. It implements the part of the
+// echarts API the page uses (init, setOption, getOption, showLoading,
+// hideLoading, resize), so a build with echarts can swap it back in.
+(function () {
+  const PALETTE = ['#5470c6', '#91cc75', '#fac858', '#ee6666', '#73c0de', '#3ba272', '#fc8452', '#9a60b4', '#ea7ccc'];
+  const FONT = '12px sans-serif';
+  const AXIS_COLOR = '#6e7079';
+  const GRID_COLOR = '#e0e6f1';
+
+  // Round a span to 1, 2 or 5 times a power of ten for axis ticks
+  function niceStep(span, count) {
+    const raw = span / Math.max(count, 1);
+    const power = Math.pow(10, Math.floor(Math.log10(raw)));
+    const fraction = raw / power;
+    return (fraction < 1.5 ? 1 : fraction < 3 ? 2 : fraction < 7 ? 5 : 10) * power;
+  }
+
+  function ticks(min, max, count) {
+    const step = niceStep(max - min, count);
+    const out = [];
+    for (let v = Math.ceil(min / step) * step; v <= max + step * 1e-9; v += step) {
+      out.push(Math.abs(v) < step * 1e-9 ? 0 : v);
+    }
+    return { values: out, step: step };
+  }
+
+  function formatTick(v, step) {
+    const decimals = Math.max(0, -Math.floor(Math.log10(step)));
+    return v.toFixed(Math.min(decimals, 6));
+  }
+
+  function escapeXml(text) {
+    return String(text).replace(/[<>&"]/g, c => ({ '<': '&lt;', '>': '&gt;', '&': '&amp;', '"': '&quot;' })[c]);
+  }
+
+  function button(label, title, onclick) {
+    const b = document.createElement('button');
+    b.textContent = label;
+    b.title = title;
+    b.onclick = onclick;
+    b.style.cssText = 'margin-left:4px;padding:2px 6px;font-size:12px;border:1px solid #dcdfe6;border-radius:4px;background:#fff;cursor:pointer';
+    return b;
+  }
+
+  function SpectrumPlot(dom) {
+    this.dom = dom;
+    this.option = { series: [] };
+    this.zoom = null;   // [xmin, xmax] while zoomed in
+    this.hidden = {};   // legend names toggled off
+    this.loading = false;
+    this.layout = null;
+
+    dom.style.position = dom.style.position || 'relative';
+    this.canvas = document.createElement('canvas');
+    this.canvas.style.cssText = 'display:block;width:100%;height:100%;touch-action:none';
+    dom.appendChild(this.canvas);
+
+    this.toolbar = document.createElement('div');
+    this.toolbar.style.cssText = 'position:absolute;top:8px;right:20px';
+    this.toolbar.appendChild(button('⟲', 'Restore Zoom', () => { this.zoom = null; this.render(); }));
+    this.toolbar.appendChild(button('PNG', 'Save as PNG', () => this.exportImage('png')));
+    this.toolbar.appendChild(button('SVG', 'Save as SVG', () => this.exportImage('svg')));
+    dom.appendChild(this.toolbar);
+
+    this.tip = document.createElement('div');
+    this.tip.style.cssText = 'position:absolute;display:none;pointer-events:none;background:rgba(255,255,255,0.95);' +
+      'border:1px solid #ccc;border-radius:4px;padding:6px 8px;font:12px sans-serif;white-space:nowrap';
+    dom.appendChild(this.tip);
+
+    this.bindEvents();
+    this.resize();
+  }
+
+  SpectrumPlot.init = function (dom) {
+    return new SpectrumPlot(dom);
+  };
+
+  SpectrumPlot.prototype.setOption = function (option, notMerge) {
+    if (notMerge) {
+      this.option = Object.assign({ series: [] }, option);
+      this.zoom = null;
+      this.hidden = {};
+    } else {
+      this.option = Object.assign({}, this.option, option);
+    }
+    this.render();
+  };
+
+  SpectrumPlot.prototype.getOption = function () {
+    return Object.assign({}, this.option, { series: (this.option.series || []).slice() });
+  };
+
+  SpectrumPlot.prototype.showLoading = function () {
+    this.loading = true;
+    this.render();
+  };
+
+  SpectrumPlot.prototype.hideLoading = function () {
+    this.loading = false;
+    this.render();
+  };
+
+  SpectrumPlot.prototype.resize = function () {
+    const ratio = window.devicePixelRatio || 1;
+    this.width = this.dom.clientWidth;
+    this.height = this.dom.clientHeight;
+    this.canvas.width = Math.round(this.width * ratio);
+    this.canvas.height = Math.round(this.height * ratio);
+    this.ratio = ratio;
+    this.render();
+  };
+
+  // Legend entries in first-seen order; series sharing a name share an entry
+  SpectrumPlot.prototype.legend = function () {
+    const entries = [];
+    const index = {};
+    (this.option.series || []).forEach(s => {
+      if (!(s.name in index)) {
+        index[s.name] = entries.length;
+        entries.push({ name: s.name, color: (s.lineStyle && s.lineStyle.color) || PALETTE[entries.length % PALETTE.length] });
+      }
+    });
+    return { entries: entries, index: index };
+  };
+
+  SpectrumPlot.prototype.visibleSeries = function (legend) {
+    return (this.option.series || [])
+      .filter(s => !this.hidden[s.name])
+      .map(s => ({
+        series: s,
+        color: (s.lineStyle && s.lineStyle.color) || legend.entries[legend.index[s.name]].color
+      }));
+  };
+
+  // Build the chart as a list of drawing primitives so that the canvas and
+  // the SVG export come out of the same code
+  SpectrumPlot.prototype.scene = function () {
+    const o = this.option;
+    const grid = Object.assign({ left: 50, right: 50, top: 80, bottom: 70 }, o.grid);
+    const xAxis = o.xAxis || {};
+    const yAxis = o.yAxis || {};
+    const w = this.width;
+    const h = this.height;
+    const box = { x: grid.left, y: grid.top, w: Math.max(w - grid.left - grid.right, 10), h: Math.max(h - grid.top - grid.bottom, 10) };
+    const prims = [];
+    const legend = this.legend();
+    const visible = this.visibleSeries(legend);
+
+    let xmin = this.zoom ? this.zoom[0] : (xAxis.min !== undefined ? xAxis.min : Infinity);
+    let xmax = this.zoom ? this.zoom[1] : (xAxis.max !== undefined ? xAxis.max : -Infinity);
+    if (!isFinite(xmin) || !isFinite(xmax)) {
+      visible.forEach(v => v.series.data.forEach(p => { xmin = Math.min(xmin, p[0]); xmax = Math.max(xmax, p[0]); }));
+      if (!isFinite(xmin)) { xmin = 0; xmax = 1; }
+    }
+    let ymax = 0;
+    visible.forEach(v => v.series.data.forEach(p => { if (p[0] >= xmin && p[0] <= xmax && p[1] > ymax) ymax = p[1]; }));
+    const ymin = yAxis.min !== undefined ? yAxis.min : 0;
+    const yt = ticks(ymin, ymax > ymin ? ymax : ymin + 1, Math.max(Math.floor(box.h / 50), 2));
+    const ytop = yt.values[yt.values.length - 1] < ymax ? yt.values[yt.values.length - 1] + yt.step : yt.values[yt.values.length - 1];
+    const xt = ticks(xmin, xmax, Math.max(Math.floor(box.w / 80), 2));
+
+    const sx = x => box.x + (x - xmin) / (xmax - xmin) * box.w;
+    const sy = y => box.y + box.h - (y - ymin) / (ytop - ymin) * box.h;
+    this.layout = { box: box, xmin: xmin, xmax: xmax, sx: sx, sy: sy, visible: visible };
+
+    if (o.title && o.title.text) {
+      prims.push({ t: 'text', x: w / 2, y: 22, text: o.title.text, align: 'center', font: 'bold 18px sans-serif', color: '#464646' });
+    }
+
+    // Legend: click toggles a series name
+    let lx = 0;
+    const items = legend.entries.map(e => {
+      const width = 28 + e.name.length * 6.5;
+      const item = { e: e, x: lx, w: width };
+      lx += width + 10;
+      return item;
+    });
+    const legendLeft = Math.max((w - lx) / 2, 10);
+    this.legendHits = [];
+    items.forEach(item => {
+      const x = legendLeft + item.x;
+      const y = (o.legend && o.legend.top) || 40;
+      const color = this.hidden[item.e.name] ? '#ccc' : item.e.color;
+      prims.push({ t: 'rect', x: x, y: y + 2, w: 20, h: 10, color: color, opacity: 1 });
+      prims.push({ t: 'text', x: x + 24, y: y + 7, text: item.e.name, align: 'left', color: this.hidden[item.e.name] ? '#ccc' : '#333' });
+      this.legendHits.push({ x: x, y: y, w: item.w, h: 14, name: item.e.name });
+    });
+
+    // Grid lines and axis labels
+    yt.values.concat(ytop > yt.values[yt.values.length - 1] ? [ytop] : []).forEach(v => {
+      prims.push({ t: 'path', pts: [[box.x, sy(v)], [box.x + box.w, sy(v)]], color: GRID_COLOR, width: 1 });
+      prims.push({ t: 'text', x: box.x - 8, y: sy(v), text: formatTick(v, yt.step), align: 'right', color: AXIS_COLOR });
+    });
+    xt.values.forEach(v => {
+      prims.push({ t: 'path', pts: [[sx(v), box.y + box.h], [sx(v), box.y + box.h + 5]], color: AXIS_COLOR, width: 1 });
+      prims.push({ t: 'text', x: sx(v), y: box.y + box.h + 16, text: formatTick(v, xt.step), align: 'center', color: AXIS_COLOR });
+    });
+    prims.push({ t: 'path', pts: [[box.x, box.y + box.h], [box.x + box.w, box.y + box.h]], color: AXIS_COLOR, width: 1 });
+    if (xAxis.name) {
+      prims.push({ t: 'text', x: box.x + box.w / 2, y: box.y + box.h + (xAxis.nameGap || 30), text: xAxis.name, align: 'center', color: AXIS_COLOR });
+    }
+    if (yAxis.name) {
+      prims.push({ t: 'text', x: box.x - (yAxis.nameGap || 35), y: box.y + box.h / 2, text: yAxis.name, align: 'center', color: AXIS_COLOR, rotate: -90 });
+    }
+
+    // Series, clipped to the plot box
+    const series = [];
+    visible.forEach(v => {
+      const pts = v.series.data.map(p => [sx(p[0]), sy(p[1])]);
+      if (pts.length === 0) return;
+      const line = v.series.lineStyle || {};
+      const area = v.series.areaStyle;
+      if (area) {
+        const base = sy(ymin);
+        series.push({ t: 'path', pts: [[pts[0][0], base]].concat(pts, [[pts[pts.length - 1][0], base]]), fill: area.color || v.color,
+                      opacity: area.opacity !== undefined ? area.opacity : 0.7 });
+      }
+      series.push({ t: 'path', pts: pts, color: v.color, width: line.width || 2, opacity: line.opacity !== undefined ? line.opacity : 1 });
+    });
+    prims.push({ t: 'clip', x: box.x, y: box.y, w: box.w, h: box.h, children: series });
+
+    if (this.selection) {
+      const a = Math.min(this.selection[0], this.selection[1]);
+      const b = Math.max(this.selection[0], this.selection[1]);
+      prims.push({ t: 'rect', x: a, y: box.y, w: b - a, h: box.h, color: '#5470c6', opacity: 0.15 });
+    }
+    if (this.loading) {
+      prims.push({ t: 'rect', x: 0, y: 0, w: w, h: h, color: '#fff', opacity: 0.7 });
+      prims.push({ t: 'text', x: w / 2, y: h / 2, text: 'Loading…', align: 'center', font: '14px sans-serif', color: '#5470c6' });
+    }
+    return prims;
+  };
+
+  function drawCanvas(ctx, prims) {
+    prims.forEach(p => {
+      ctx.save();
+      ctx.globalAlpha = p.opacity !== undefined ? p.opacity : 1;
+      if (p.t === 'clip') {
+        ctx.beginPath();
+        ctx.rect(p.x, p.y, p.w, p.h);
+        ctx.clip();
+        drawCanvas(ctx, p.children);
+      } else if (p.t === 'rect') {
+        ctx.fillStyle = p.color;
+        ctx.fillRect(p.x, p.y, p.w, p.h);
+      } else if (p.t === 'path') {
+        ctx.beginPath();
+        p.pts.forEach((pt, i) => (i ? ctx.lineTo(pt[0], pt[1]) : ctx.moveTo(pt[0], pt[1])));
+        if (p.fill) {
+          ctx.closePath();
+          ctx.fillStyle = p.fill;
+          ctx.fill();
+        } else {
+          ctx.strokeStyle = p.color;
+          ctx.lineWidth = p.width;
+          ctx.lineJoin = 'round';
+          ctx.stroke();
+        }
+      } else if (p.t === 'text') {
+        ctx.font = p.font || FONT;
+        ctx.fillStyle = p.color;
+        ctx.textAlign = p.align;
+        ctx.textBaseline = 'middle';
+        ctx.translate(p.x, p.y);
+        if (p.rotate) ctx.rotate(p.rotate * Math.PI / 180);
+        ctx.fillText(p.text, 0, 0);
+      }
+      ctx.restore();
+    });
+  }
+
+  function toSvg(prims, w, h) {
+    let clipId = 0;
+    function emit(list) {
+      return list.map(p => {
+        const opacity = p.opacity !== undefined && p.opacity !== 1 ? ` opacity="${p.opacity}"` : '';
+        if (p.t === 'clip') {
+          const id = 'c' + clipId++;
+          return `<clipPath id="${id}"><rect x="${p.x}" y="${p.y}" width="${p.w}" height="${p.h}"/></clipPath>` +
+                 `<g clip-path="url(#${id})">${emit(p.children)}</g>`;
+        }
+        if (p.t === 'rect') {
+          return `<rect x="${p.x}" y="${p.y}" width="${p.w}" height="${p.h}" fill="${p.color}"${opacity}/>`;
+        }
+        if (p.t === 'path') {
+          const d = p.pts.map((pt, i) => (i ? 'L' : 'M') + pt[0].toFixed(1) + ' ' + pt[1].toFixed(1)).join('');
+          return p.fill
+            ? `<path d="${d}Z" fill="${p.fill}"${opacity}/>`
+            : `<path d="${d}" fill="none" stroke="${p.color}" stroke-width="${p.width}" stroke-linejoin="round"${opacity}/>`;
+        }
+        const anchor = { left: 'start', center: 'middle', right: 'end' }[p.align];
+        const rotate = p.rotate ? ` transform="rotate(${p.rotate} ${p.x} ${p.y})"` : '';
+        return `<text x="${p.x}" y="${p.y}" dominant-baseline="middle" text-anchor="${anchor}" fill="${p.color}" ` +
+               `style="font:${p.font || FONT}"${rotate}>${escapeXml(p.text)}</text>`;
+      }).join('');
+    }
+    return `<svg xmlns="http://www.w3.org/2000/svg" width="${w}" height="${h}" viewBox="0 0 ${w} ${h}">` +
+           `<rect width="100%" height="100%" fill="#fff"/>${emit(prims)}</svg>`;
+  }
+
+  SpectrumPlot.prototype.render = function () {
+    if (!this.canvas || !this.width) return;
+    const ctx = this.canvas.getContext('2d');
+    ctx.setTransform(this.ratio, 0, 0, this.ratio, 0, 0);
+    ctx.clearRect(0, 0, this.width, this.height);
+    drawCanvas(ctx, this.scene());
+  };
+
+  SpectrumPlot.prototype.exportImage = function (type) {
+    const save = this.option.toolbox && this.option.toolbox.feature && this.option.toolbox.feature.saveAsImage;
+    const link = document.createElement('a');
+    link.download = ((save && save.name) || 'chart') + '.' + type;
+    if (type === 'svg') {
+      const blob = new Blob([toSvg(this.scene(), this.width, this.height)], { type: 'image/svg+xml' });
+      link.href = URL.createObjectURL(blob);
+    } else {
+      const out = document.createElement('canvas');
+      out.width = this.canvas.width;
+      out.height = this.canvas.height;
+      const ctx = out.getContext('2d');
+      ctx.fillStyle = '#fff';
+      ctx.fillRect(0, 0, out.width, out.height);
+      ctx.drawImage(this.canvas, 0, 0);
+      link.href = out.toDataURL('image/png');
+    }
+    document.body.appendChild(link);
+    link.click();
+    document.body.removeChild(link);
+    if (type === 'svg') URL.revokeObjectURL(link.href);
+  };
+
+  // Nearest point of each tooltip-enabled series to wavelength x
+  SpectrumPlot.prototype.pointsAt = function (x) {
+    const params = [];
+    this.layout.visible.forEach(v => {
+      if (v.series.tooltip && v.series.tooltip.show === false) return;
+      let best = null;
+      v.series.data.forEach(p => { if (!best || Math.abs(p[0] - x) < Math.abs(best[0] - x)) best = p; });
+      if (best) params.push({ seriesName: v.series.name, value: best, color: v.color });
+    });
+    return params;
+  };
+
+  SpectrumPlot.prototype.bindEvents = function () {
+    const canvas = this.canvas;
+    const local = e => {
+      const r = canvas.getBoundingClientRect();
+      return [e.clientX - r.left, e.clientY - r.top];
+    };
+    const inBox = pt => {
+      const b = this.layout && this.layout.box;
+      return b && pt[0] >= b.x && pt[0] <= b.x + b.w && pt[1] >= b.y && pt[1] <= b.y + b.h;
+    };
+    const toX = px => {
+      const l = this.layout;
+      return l.xmin + (px - l.box.x) / l.box.w * (l.xmax - l.xmin);
+    };
+
+    canvas.addEventListener('pointerdown', e => {
+      const pt = local(e);
+      const hit = (this.legendHits || []).find(l => pt[0] >= l.x && pt[0] <= l.x + l.w && pt[1] >= l.y && pt[1] <= l.y + l.h);
+      if (hit) {
+        this.hidden[hit.name] = !this.hidden[hit.name];
+        this.render();
+        return;
+      }
+      if (inBox(pt)) {
+        this.selection = [pt[0], pt[0]];
+        canvas.setPointerCapture(e.pointerId);
+      }
+    });
+
+    canvas.addEventListener('pointermove', e => {
+      const pt = local(e);
+      if (this.selection) {
+        const b = this.layout.box;
+        this.selection[1] = Math.min(Math.max(pt[0], b.x), b.x + b.w);
+        this.render();
+      }
+      const params = inBox(pt) ? this.pointsAt(toX(pt[0])) : [];
+      if (params.length === 0) {
+        this.tip.style.display = 'none';
+        return;
+      }
+      const tooltip = this.option.tooltip || {};
+      this.tip.innerHTML = tooltip.formatter
+        ? tooltip.formatter(params)
+        : params.map(p => `${escapeXml(p.seriesName)}: ${p.value[1].toFixed(4)}`).join('<br/>');
+      this.tip.style.display = 'block';
+      this.tip.style.left = Math.min(pt[0] + 12, this.width - this.tip.offsetWidth - 4) + 'px';
+      this.tip.style.top = Math.max(pt[1] - this.tip.offsetHeight - 12, 0) + 'px';
+    });
+
+    canvas.addEventListener('pointerleave', () => { this.tip.style.display = 'none'; });
+
+    // Dragging across the plot zooms to that wavelength range
+    canvas.addEventListener('pointerup', () => {
+      if (!this.selection) return;
+      const a = Math.min(this.selection[0], this.selection[1]);
+      const b = Math.max(this.selection[0], this.selection[1]);
+      this.selection = null;
+      if (b - a > 5) this.zoom = [toX(a), toX(b)];
+      this.render();
+    });
+
+    canvas.addEventListener('dblclick', () => { this.zoom = null; this.render(); });
+  };
+
+  window.SpectrumPlot = SpectrumPlot;
+})();
@@ -0,0 +1,8 @@
+// Generated by tools/build_assets.py from the files in web/. Do not edit.
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+// The web UI is served from LittleFS; upload the data/ folder.
+#define WEB_ASSETS_LITTLEFS
+
+#endif
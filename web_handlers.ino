@@ -1,5 +1,8 @@
 #include "config.h"
-#include "html_pages.h"
+#include "web_assets.h"
+#ifdef USE_ECHARTS
+#include "echarts_min_js.h"
+#endif
 #include <WiFi.h>
 
 void startAPMode() {
@@ -13,13 +16,50 @@ void startAPMode() {
   Serial.println(WiFi.softAPIP());
 }
 
-void handleRoot() {
-  String html = String(MAIN_PAGE_START) + ssid + String(MAIN_PAGE_END);
-  server.send(200, "text/html", html);
+// Send the ETag and answer 304 if the client already has this version. By
+// default responses are always revalidated, which costs a header exchange at most.
+bool notModified(const char* etag, const char* cacheControl) {
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", cacheControl);
+  if (server.header("If-None-Match").indexOf(etag) >= 0) {
+    server.send(304);
+    return true;
+  }
+  return false;
+}
+
+// Pages and their scripts are gzipped in flash (web_assets.h). Hashed
+// script and style URLs never change content, so browsers keep them for good;
+// pages are revalidated by ETag. The SSID is filled in from /getconfig.
+void serveAsset(const WebAsset& asset) {
+  if (asset.immutable) {
+    server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  } else if (notModified(asset.etag)) {
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, asset.contentType, (const char*)asset.data, asset.length);
 }
 
-void handleConfig() {
-  server.send_P(200, "text/html", CONFIG_PAGE);
+// Assets built with --embed are compiled in; otherwise handleStaticFile()
+// serves them from LittleFS
+void registerWebAssets() {
+#ifndef WEB_ASSETS_LITTLEFS
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset* asset = &WEB_ASSETS[i];
+    server.on(asset->path, HTTP_GET, timedHandler(asset->path, [asset]() { serveAsset(*asset); }));
+  }
+#endif
+#ifdef USE_ECHARTS
+  // Only pages generated with build_assets.py --embed --echarts ask for this
+  server.on("/echarts.min.js", HTTP_GET, [](){
+    server.sendHeader("Content-Encoding", "gzip");
+    server.sendHeader("Cache-Control", "max-age=86400");
+    server.send_P(200, "application/javascript", 
+                  (const char*)ECHARTS_JS_GZ, 
+                  ECHARTS_JS_GZ_LEN);
+  });
+#endif
 }
 
 void handleSaveWifi() {
@@ -37,66 +77,205 @@ void handleSaveWifi() {
 }
 
 void handleStart() {
-  if (collecting) {
+  uint32_t scanId = requestScan();
+  if (scanId == 0) {
     server.send(400, "text/plain", "Collection already in progress.");
     return;
   }
-  collecting = true;
-  scanStartTime = millis();
-  scanElapsedTime = 0;
-  
-  // Perform data collection and processing
-  readAndAccumulate();
-  generateInterpolatedSpectrum();
-  
-  scanElapsedTime = millis() - scanStartTime;
-  collecting = false;
-  Serial.println("Data collection and processing complete.");
-  server.send(200, "text/plain", "Collection complete");
+  // The scan runs on the sensor task; clients poll /status until completedScanId catches up
+  String json = "{\"scanId\": " + String(scanId) + "}";
+  server.send(202, "application/json", json);
 }
 
-void handleData() {
+// Capture a dark reference for the current exposure settings (sensor covered),
+// or drop all stored references with ?clear=1
+void handleDark() {
+  if (server.hasArg("clear")) {
+    if (acqState != ACQ_IDLE) {
+      server.send(400, "text/plain", "Collection already in progress.");
+      return;
+    }
+    clearDark();
+    server.send(200, "text/plain", "Dark references cleared.");
+    return;
+  }
+  uint32_t scanId = requestScan(SCAN_DARK);
+  if (scanId == 0) {
+    server.send(400, "text/plain", "Collection already in progress.");
+    return;
+  }
+  String json = "{\"scanId\": " + String(scanId) + "}";
+  server.send(202, "application/json", json);
+}
+
+// Turn the device-side scan scheduler on or off (?state=on|off)
+void handleContinuous() {
+  if (!server.hasArg("state")) {
+    server.send(400, "text/plain", "Missing state parameter");
+    return;
+  }
+  setContinuous(server.arg("state") == "on");
+  server.send(200, "text/plain", continuousMode ? "Continuous ON" : "Continuous OFF");
+}
+
+// Serialize one scan as the /data JSON document into out. Also used for
+// /events. Returns the length, or 0 if out was too small.
+size_t dataJson(const SpectrumFrame& frame, char* out, size_t capacity) {
+  JsonWriter w;
+  jsonBegin(w, out, capacity);
+
   // Create a JSON object with three properties: interpolated, raw, and labels
-  String json = "{";
+  jsonRaw(w, "{\"scanId\":");
+  jsonUInt(w, frame.scanId);
 
   // 1. Add interpolated data
-  json += "\"interpolated\":[";
+  jsonRaw(w, ",\"interpolated\":[");
   for (int i = 0; i < interpolationPoints; i++) {
-    json += "[" + String(interpolatedSpectrum[i][0], 2) + "," + String(interpolatedSpectrum[i][1], 4) + "]";
-    if (i < interpolationPoints - 1) json += ",";
+    if (i > 0) jsonRaw(w, ",");
+    jsonRaw(w, "[");
+    jsonFixed(w, frame.interpolated[i][0], 2);
+    jsonRaw(w, ",");
+    jsonFixed(w, frame.interpolated[i][1], 6);
+    jsonRaw(w, "]");
   }
-  json += "],";
 
   // 2. Add raw channel data (9 channels, excluding Clear)
-  json += "\"raw\":[";
+  jsonRaw(w, "],\"raw\":[");
   for (int i = 0; i < 9; i++) {
-    json += "[" + String(channelWavelengths[i]) + "," + String(normalizedReadings[i], 4) + "]";
-    if (i < 8) json += ",";
+    if (i > 0) jsonRaw(w, ",");
+    jsonRaw(w, "[");
+    jsonFixed(w, channelWavelengths[i], 2);
+    jsonRaw(w, ",");
+    jsonFixed(w, frame.readings[i], 6);
+    jsonRaw(w, "]");
   }
-  json += "],";
 
   // 3. Add channel names for labels (9 channels)
-  json += "\"labels\":[";
+  jsonRaw(w, "],\"labels\":[");
   for (int i = 0; i < 9; i++) {
-    json += "\"" + String(channelNames[i]) + "\"";
-    if (i < 8) json += ",";
+    if (i > 0) jsonRaw(w, ",");
+    jsonString(w, channelNames[i]);
   }
-  json += "],";
 
-  // 4. Add connector line data
-  json += "\"connector\":[";
-  // First point: last point of interpolated spectrum
-  json += "[" + String(interpolatedSpectrum[interpolationPoints - 1][0], 2) + "," + String(interpolatedSpectrum[interpolationPoints - 1][1], 4) + "],";
-  // Second point: the NIR channel raw data (index 8)
-  json += "[" + String(channelWavelengths[8]) + "," + String(normalizedReadings[8], 4) + "]";
-  json += "]";
+  // 4. Add connector line data: last point of the interpolated spectrum, then
+  // the NIR channel raw data (index 8)
+  jsonRaw(w, "],\"connector\":[[");
+  jsonFixed(w, frame.interpolated[interpolationPoints - 1][0], 2);
+  jsonRaw(w, ",");
+  jsonFixed(w, frame.interpolated[interpolationPoints - 1][1], 6);
+  jsonRaw(w, "],[");
+  jsonFixed(w, channelWavelengths[8], 2);
+  jsonRaw(w, ",");
+  jsonFixed(w, frame.readings[8], 6);
 
-  json += "}";
-  server.send(200, "application/json", json);
+  // 5. Exposure of each SMUX group; readings are in basic counts (counts / gain / ms)
+  jsonRaw(w, "]],\"exposure\":[");
+  for (int g = 0; g < 2; g++) {
+    if (g > 0) jsonRaw(w, ",");
+    jsonRaw(w, "{\"gain\":");
+    jsonFixed(w, as7341GainFactor(frame.exposure[g].gain), 1);
+    jsonRaw(w, ",\"integrationMs\":");
+    jsonFixed(w, as7341IntegrationTimeUs(frame.exposure[g]) / 1000.0f, 1);
+    jsonRaw(w, "}");
+  }
+
+  // 6. Per-channel saturation flags (9 channels) and whether HDR merging was used
+  jsonRaw(w, "],\"saturated\":[");
+  for (int i = 0; i < 9; i++) {
+    if (i > 0) jsonRaw(w, ",");
+    jsonBool(w, frame.saturated[i]);
+  }
+  jsonRaw(w, "],\"hdr\":");
+  jsonBool(w, frame.hdr);
+  jsonRaw(w, ",\"darkCorrected\":");
+  jsonBool(w, frame.darkCorrected);
+  jsonRaw(w, "}");
+
+  return w.overflow ? 0 : w.len;
+}
+
+// Binary clients ask with ?fmt=bin or Accept: application/octet-stream
+bool wantsBinary() {
+  if (server.hasArg("fmt")) {
+    return server.arg("fmt") == "bin";
+  }
+  return server.header("Accept").indexOf("application/octet-stream") >= 0;
+}
+
+// Serialized payloads of the latest scan, rebuilt at most once per scan no
+// matter how many clients ask. Only touched from loop().
+char dataJsonCache[DATA_JSON_SIZE];
+size_t dataJsonCacheLen = 0;
+uint32_t dataJsonCacheId = 0;
+uint8_t dataBinCache[SPECTRUM_BIN_SIZE];
+size_t dataBinCacheLen = 0;
+uint32_t dataBinCacheId = 0;
+SpectrumFrame dataCacheFrame;
+
+// Scan ids restart at 1 on every boot, so ETags carry a per-boot tag as well
+uint32_t bootTag = 0;
+
+const char* cachedDataJson(size_t& len, uint32_t& scanId) {
+  if (dataJsonCacheLen == 0 || dataJsonCacheId != latestSpectrumId()) {
+    readLatestSpectrum(dataCacheFrame);
+    uint32_t span = traceBegin();
+    dataJsonCacheLen = dataJson(dataCacheFrame, dataJsonCache, sizeof(dataJsonCache));
+    metricsObserve(serializeJsonLatency, traceEnd(span, "serialize json", "http"));
+    dataJsonCacheId = dataCacheFrame.scanId;
+  }
+  len = dataJsonCacheLen;
+  scanId = dataJsonCacheId;
+  return dataJsonCache;
+}
+
+const uint8_t* cachedDataBin(size_t& len, uint32_t& scanId) {
+  if (dataBinCacheLen == 0 || dataBinCacheId != latestSpectrumId()) {
+    readLatestSpectrum(dataCacheFrame);
+    uint32_t span = traceBegin();
+    dataBinCacheLen = encodeSpectrum(dataCacheFrame, dataBinCache);
+    metricsObserve(serializeBinLatency, traceEnd(span, "serialize bin", "http"));
+    dataBinCacheId = dataCacheFrame.scanId;
+  }
+  len = dataBinCacheLen;
+  scanId = dataBinCacheId;
+  return dataBinCache;
+}
+
+void handleData() {
+  bool binary = wantsBinary();
+  size_t len;
+  uint32_t scanId;
+  const char* body = binary ? (const char*)cachedDataBin(len, scanId) : cachedDataJson(len, scanId);
+  if (len == 0) {
+    server.send(500, "text/plain", "Scan does not fit the response buffer.");
+    return;
+  }
+
+  if (bootTag == 0) bootTag = esp_random() | 1;
+  char etag[32];
+  snprintf(etag, sizeof(etag), "\"%08lx-%lu%s\"", (unsigned long)bootTag, (unsigned long)scanId, binary ? "b" : "");
+  server.sendHeader("Vary", "Accept");
+  if (notModified(etag)) return;
+  server.setContentLength(len);
+  server.send(200, binary ? "application/octet-stream" : "application/json", "");
+  server.sendContent(body, len);
 }
 
 void handleGetConfig() {
-  String json = "{\"accumulationTime\": " + String(accumulationTime) + ", \"scanInterval\": " + String(scanInterval) + "}";
+  String json = "{\"accumulationTime\": " + String(accumulationTime) + ", \"scanInterval\": " + String(scanInterval) +
+                ", \"autoExposure\": " + String(autoExposure ? "true" : "false") + ", \"exposureTarget\": " + String(exposureTarget, 2) +
+                ", \"hdr\": " + String(hdrMode ? "true" : "false") +
+                ", \"continuous\": " + String(continuousMode ? "true" : "false") +
+                ", \"gain\": " + String(sensorGain) + ", \"atime\": " + String(sensorAtime) +
+                ", \"astep\": " + String(sensorAstep) +
+                ", \"sensorI2cClock\": " + String(i2cConfiguredClock(I2C_BUS_SENSOR)) +
+                ", \"oledI2cClock\": " + String(i2cConfiguredClock(I2C_BUS_OLED)) + ", \"ssid\": ";
+  char name[200];
+  JsonWriter w;
+  jsonBegin(w, name, sizeof(name));
+  jsonString(w, ssid.c_str());
+  json += name;
+  json += "}";
   server.send(200, "application/json", json);
 }
 
@@ -104,16 +283,51 @@ void handleSetConfig() {
   bool updated = false;
   if (server.hasArg("accumulationTime")) {
     accumulationTime = server.arg("accumulationTime").toInt();
-    if (accumulationTime < 1) accumulationTime = 1;
-    if (accumulationTime > 60) accumulationTime = 60;
+    accumulationTime = constrain(accumulationTime, 1, ACCUMULATION_TIME_MAX);
     updated = true;
   }
   if (server.hasArg("scanInterval")) {
     scanInterval = server.arg("scanInterval").toInt();
-    if (scanInterval < 1) scanInterval = 1;
-    if (scanInterval > 3600) scanInterval = 3600;
+    scanInterval = constrain(scanInterval, 1, SCAN_INTERVAL_MAX);
+    updated = true;
+  }
+  if (server.hasArg("autoExposure")) {
+    String value = server.arg("autoExposure");
+    autoExposure = (value == "1" || value == "true" || value == "on");
+    updated = true;
+  }
+  if (server.hasArg("hdr")) {
+    String value = server.arg("hdr");
+    hdrMode = (value == "1" || value == "true" || value == "on");
+    updated = true;
+  }
+  if (server.hasArg("exposureTarget")) {
+    exposureTarget = server.arg("exposureTarget").toFloat();
+    exposureTarget = constrain(exposureTarget, EXPOSURE_TARGET_MIN, EXPOSURE_TARGET_MAX);
     updated = true;
   }
+  // Manual exposure, used while autoExposure is off
+  if (server.hasArg("gain")) {
+    sensorGain = constrain(server.arg("gain").toInt(), 0, SENSOR_GAIN_MAX);
+    updated = true;
+  }
+  if (server.hasArg("atime")) {
+    sensorAtime = constrain(server.arg("atime").toInt(), 0, 255);
+    updated = true;
+  }
+  if (server.hasArg("astep")) {
+    sensorAstep = constrain(server.arg("astep").toInt(), 0, SENSOR_ASTEP_MAX);
+    updated = true;
+  }
+  // 100000, 400000 or 1000000; anything else is ignored
+  if (server.hasArg("sensorI2cClock")) {
+    xSemaphoreTake(i2cMutex, portMAX_DELAY);
+    updated |= setI2cClock(I2C_BUS_SENSOR, server.arg("sensorI2cClock").toInt());
+    xSemaphoreGive(i2cMutex);
+  }
+  if (server.hasArg("oledI2cClock")) {
+    updated |= setI2cClock(I2C_BUS_OLED, server.arg("oledI2cClock").toInt());
+  }
   
   if (updated) {
     server.send(200, "text/plain", "Configuration updated.");
@@ -0,0 +1,173 @@
+#include "config.h"
+
+// Binary command channel on ws://<device>:WS_PORT/ for automation clients.
+// The REST handlers stay; this is the same set of actions without a TCP
+// connection and header parse per request. All values are little endian.
+//
+//   request:  [op u8][tag u8][payload...]
+//   response: [op | 0x80][tag][status u8][payload...]   tag is echoed back
+//   notify:   [WS_NOTIFY_SCAN][0][WS_OK][scanId u32]    sent when a scan completes
+//
+//   WS_OP_START       -                                      -> scanId u32
+//   WS_OP_DARK        [clear u8] (optional)                  -> scanId u32 (0 when cleared)
+//   WS_OP_LIGHT       [on u8]                                -> -
+//   WS_OP_CONTINUOUS  [on u8]                                -> -
+//   WS_OP_SET_CONFIG  [mask u8][accumulationTime u16][scanInterval u16]
+//                     [flags u8][exposureTarget u8 percent]  -> -
+//   WS_OP_GET_CONFIG  -                                      -> SET_CONFIG payload without the mask
+//   WS_OP_STATUS      -                                      -> [state u8][scanId u32][completedScanId u32][progress u8 percent]
+//   WS_OP_GET_DATA    -                                      -> latest scan, encoded as in spectrum_format.ino
+//
+// SET_CONFIG mask bits select which fields apply, in field order (flags
+// counts as two: WS_CFG_AUTO_EXPOSURE and WS_CFG_HDR).
+#define WS_OP_START 0x01
+#define WS_OP_DARK 0x02
+#define WS_OP_LIGHT 0x03
+#define WS_OP_CONTINUOUS 0x04
+#define WS_OP_SET_CONFIG 0x05
+#define WS_OP_GET_CONFIG 0x06
+#define WS_OP_STATUS 0x07
+#define WS_OP_GET_DATA 0x08
+#define WS_RESPONSE 0x80
+#define WS_NOTIFY_SCAN 0xC0
+
+#define WS_OK 0
+#define WS_BUSY 1
+#define WS_BAD_REQUEST 2
+#define WS_UNKNOWN_OP 3
+
+#define WS_CFG_ACCUMULATION_TIME 0x01
+#define WS_CFG_SCAN_INTERVAL 0x02
+#define WS_CFG_AUTO_EXPOSURE 0x04
+#define WS_CFG_HDR 0x08
+#define WS_CFG_EXPOSURE_TARGET 0x10
+
+// flags byte of the config payload
+#define WS_FLAG_AUTO_EXPOSURE 0x01
+#define WS_FLAG_HDR 0x02
+#define WS_FLAG_CONTINUOUS 0x04
+
+WebSocketsServer webSocket(WS_PORT);
+uint32_t wsNotifiedScanId = 0;
+
+void wsApplyConfig(const uint8_t* p, uint8_t mask) {
+  if (mask & WS_CFG_ACCUMULATION_TIME) {
+    accumulationTime = constrain(binGet16(p), 1, ACCUMULATION_TIME_MAX);
+  }
+  if (mask & WS_CFG_SCAN_INTERVAL) {
+    scanInterval = constrain(binGet16(p + 2), 1, SCAN_INTERVAL_MAX);
+  }
+  if (mask & WS_CFG_AUTO_EXPOSURE) {
+    autoExposure = p[4] & WS_FLAG_AUTO_EXPOSURE;
+  }
+  if (mask & WS_CFG_HDR) {
+    hdrMode = p[4] & WS_FLAG_HDR;
+  }
+  if (mask & WS_CFG_EXPOSURE_TARGET) {
+    exposureTarget = constrain(p[5] / 100.0f, EXPOSURE_TARGET_MIN, EXPOSURE_TARGET_MAX);
+  }
+}
+
+// Run one command and build its response after the 3-byte response header
+size_t wsExecute(uint8_t op, const uint8_t* payload, size_t length, uint8_t* out, uint8_t& status) {
+  uint8_t* p = out;
+  status = WS_OK;
+  switch (op) {
+    case WS_OP_START: {
+      uint32_t scanId = requestScan();
+      if (scanId == 0) status = WS_BUSY;
+      p = binPut32(p, scanId);
+      break;
+    }
+    case WS_OP_DARK: {
+      uint32_t scanId = 0;
+      if (length >= 1 && payload[0]) {
+        if (acqState != ACQ_IDLE) {
+          status = WS_BUSY;
+        } else {
+          clearDark();
+        }
+      } else {
+        scanId = requestScan(SCAN_DARK);
+        if (scanId == 0) status = WS_BUSY;
+      }
+      p = binPut32(p, scanId);
+      break;
+    }
+    case WS_OP_LIGHT:
+      if (length < 1) {
+        status = WS_BAD_REQUEST;
+      } else {
+        setLight(payload[0]);
+      }
+      break;
+    case WS_OP_CONTINUOUS:
+      if (length < 1) {
+        status = WS_BAD_REQUEST;
+      } else {
+        setContinuous(payload[0]);
+      }
+      break;
+    case WS_OP_SET_CONFIG:
+      if (length < 7) {
+        status = WS_BAD_REQUEST;
+      } else {
+        wsApplyConfig(payload + 1, payload[0]);
+      }
+      break;
+    case WS_OP_GET_CONFIG:
+      p = binPut16(p, accumulationTime);
+      p = binPut16(p, scanInterval);
+      p = binPut8(p, (autoExposure ? WS_FLAG_AUTO_EXPOSURE : 0) | (hdrMode ? WS_FLAG_HDR : 0) |
+                    (continuousMode ? WS_FLAG_CONTINUOUS : 0));
+      p = binPut8(p, lroundf(exposureTarget * 100));
+      break;
+    case WS_OP_STATUS:
+      p = binPut8(p, acqState);
+      p = binPut32(p, currentScanId);
+      p = binPut32(p, completedScanId);
+      p = binPut8(p, lroundf(acquisitionProgress() * 100));
+      break;
+    case WS_OP_GET_DATA: {
+      size_t len;
+      uint32_t scanId;
+      const uint8_t* data = cachedDataBin(len, scanId);
+      memcpy(p, data, len);
+      p += len;
+      break;
+    }
+    default:
+      status = WS_UNKNOWN_OP;
+      break;
+  }
+  return p - out;
+}
+
+void webSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
+  if (type != WStype_BIN || length < 2) {
+    return;
+  }
+  static uint8_t response[3 + SPECTRUM_BIN_SIZE];
+  uint8_t status;
+  size_t len = wsExecute(payload[0], payload + 2, length - 2, response + 3, status);
+  response[0] = payload[0] | WS_RESPONSE;
+  response[1] = payload[1];
+  response[2] = status;
+  webSocket.sendBIN(num, response, 3 + len);
+}
+
+void webSocketBegin() {
+  webSocket.begin();
+  webSocket.onEvent(webSocketEvent);
+}
+
+// Called from loop(), the same task that serves HTTP
+void serviceWebSocket() {
+  webSocket.loop();
+  if (completedScanId != wsNotifiedScanId) {
+    wsNotifiedScanId = completedScanId;
+    uint8_t notify[7] = {WS_NOTIFY_SCAN, 0, WS_OK};
+    binPut32(notify + 3, completedScanId);
+    webSocket.broadcastBIN(notify, sizeof(notify));
+  }
+}